@@ -0,0 +1,1259 @@
+#include "duplicates.h"
+#include "hasher.h"
+#include "io_pressure.h"
+#include "io_throttle.h"
+#include "log_pipeline.h"
+#include "sha256_batch.h"
+#include "sparse_file.h"
+#include "text.h"
+#include "thread_pool.h"
+#include "traversal.h"
+#include "uring_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/perf_event.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Options shared by every benchmark; each one picks the ones it needs
+struct BenchOptions {
+    fs::path dir;
+    uintmax_t files = 256;
+    uintmax_t file_size = 4 * 1024 * 1024;
+    unsigned threads = 0;
+    unsigned repeat = 3;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double MiBPerSecond(uintmax_t bytes, double seconds) {
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+// Write `count` files of `size` bytes into dir. Every content is written twice, so each
+// file has exactly one duplicate and every byte takes part in the full hash pass.
+void CreateDuplicatePairs(const fs::path& dir, uintmax_t count, uintmax_t size) {
+    fs::create_directories(dir);
+
+    std::mt19937_64 random(42);
+    std::vector<char> buffer(static_cast<size_t>(size));
+    for (uintmax_t i = 0; i < count; i += 2) {
+        for (size_t j = 0; j + sizeof(uint64_t) <= buffer.size(); j += sizeof(uint64_t)) {
+            uint64_t value = random();
+            std::memcpy(&buffer[j], &value, sizeof(value));
+        }
+
+        for (uintmax_t copy = i; copy < std::min(i + 2, count); ++copy) {
+            std::ofstream file(dir / ("file" + std::to_string(copy)), std::ios::binary);
+            file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        }
+    }
+}
+
+// Counts the system calls of this process and the threads it starts while the counter lives,
+// through the raw_syscalls:sys_enter tracepoint. Needs Linux with tracefs mounted and the
+// permission to open tracepoint events (root, or a low perf_event_paranoid); elsewhere Read
+// returns nothing.
+class SyscallCounter {
+public:
+    SyscallCounter() {
+#ifdef __linux__
+        uint64_t id = 0;
+        for (const char* path : { "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                 "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id" }) {
+            if (std::ifstream(path) >> id) {
+                break;
+            }
+        }
+        if (id == 0) {
+            return;
+        }
+
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = id;
+        attr.inherit = 1;
+        m_fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    SyscallCounter(const SyscallCounter&) = delete;
+    SyscallCounter& operator=(const SyscallCounter&) = delete;
+
+    ~SyscallCounter() {
+#ifdef __linux__
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+#endif
+    }
+
+    // System calls so far, including those of threads that have exited
+    std::optional<uint64_t> Read() const {
+#ifdef __linux__
+        uint64_t count = 0;
+        if (m_fd >= 0 && ::read(m_fd, &count, sizeof(count)) == sizeof(count)) {
+            return count;
+        }
+#endif
+        return std::nullopt;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+// Create a tree of `count` empty files, 64 per directory, with 8 subdirectories per directory
+void CreateTree(const fs::path& dir, uintmax_t count) {
+    constexpr uintmax_t files_per_directory = 64;
+    constexpr uintmax_t fanout = 8;
+
+    std::vector<fs::path> directories = { dir };
+    for (size_t next = 0; count > 0; ++next) {
+        const fs::path current = directories[next];
+        fs::create_directories(current);
+        for (uintmax_t i = 0; i < files_per_directory && count > 0; ++i, --count) {
+            std::ofstream(current / ("file" + std::to_string(i)));
+        }
+        for (uintmax_t i = 0; i < fanout; ++i) {
+            directories.push_back(current / ("dir" + std::to_string(i)));
+        }
+    }
+}
+
+// Sorted copy of a scan result so that runs can be compared regardless of map order
+std::map<std::string, std::vector<fs::path>> Normalize(const DuplicateMap& duplicates) {
+    std::map<std::string, std::vector<fs::path>> result;
+    for (const auto& [hash, files] : duplicates) {
+        auto& sorted = result[hash_to_string(hash)];
+        sorted = files;
+        std::sort(sorted.begin(), sorted.end());
+    }
+    return result;
+}
+
+// Compare the single-threaded scan against the worker pool on the same tree
+int BenchThreads(const BenchOptions& options) {
+    CreateDuplicatePairs(options.dir, options.files, options.file_size);
+
+    const unsigned threads = options.threads ? options.threads : ThreadPool::DefaultThreadCount();
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes\n";
+
+    std::map<std::string, std::vector<fs::path>> reference;
+    for (unsigned threadCount : { 1u, threads }) {
+        ScanOptions scanOptions;
+        scanOptions.thread_count = threadCount;
+
+        double best = 0;
+        ScanSummary summary;
+        DuplicateMap duplicates;
+        for (unsigned run = 0; run < options.repeat; ++run) {
+            auto start = Clock::now();
+            duplicates = find_duplicate_files({ options.dir }, scanOptions, summary);
+            double seconds = SecondsSince(start);
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+
+        auto normalized = Normalize(duplicates);
+        if (threadCount == 1) {
+            reference = normalized;
+        }
+        else if (normalized != reference) {
+            std::cerr << "Result with " << threadCount << " threads differs from the single-threaded scan\n";
+            return EXIT_FAILURE;
+        }
+
+        const uintmax_t bytes = summary.head_tail_bytes + summary.middle_bytes + summary.full_hash_bytes;
+        std::cout << std::setw(3) << threadCount << " thread(s): " << std::fixed << std::setprecision(3)
+            << best << " s, " << std::setprecision(1) << MiBPerSecond(bytes, best) << " MiB/s, "
+            << duplicates.size() << " groups\n";
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Walk the same tree with both traversal backends and a growing number of threads, counting the
+// system calls of every walk where the kernel lets us
+int BenchTraversal(const BenchOptions& options) {
+    CreateTree(options.dir, options.files);
+
+    const unsigned maxThreads = options.threads ? options.threads : ThreadPool::DefaultThreadCount();
+    std::cout << "files: " << options.files << '\n';
+
+    for (TraversalBackend backend : { TraversalBackend::Filesystem, TraversalBackend::Getdents }) {
+        for (unsigned threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreads)) {
+            double best = 0;
+            uintmax_t files = 0;
+            std::optional<uint64_t> syscalls;
+            TraversalBackend used = backend;
+            for (unsigned run = 0; run < options.repeat; ++run) {
+                files = 0;
+                SyscallCounter counter;
+                auto start = Clock::now();
+                {
+                    ParallelTraverser traverser({ options.dir }, threadCount, backend);
+                    used = traverser.GetBackend();
+                    TraversalBatch batch;
+                    while (traverser.Next(batch)) {
+                        files += batch.files.size();
+                    }
+                }
+                double seconds = SecondsSince(start);
+                syscalls = counter.Read();
+                best = run == 0 ? seconds : std::min(best, seconds);
+            }
+            if (used != backend) {
+                std::cout << "getdents is not available on this platform\n";
+                break;
+            }
+
+            std::cout << std::left << std::setw(11) << (backend == TraversalBackend::Getdents ? "getdents" : "filesystem")
+                << std::right << std::setw(3) << threadCount << " thread(s): " << std::fixed << std::setprecision(3)
+                << best << " s, " << std::setprecision(0) << (best > 0 ? files / best : 0.0) << " files/s, ";
+            if (syscalls) {
+                std::cout << *syscalls << " syscalls\n";
+            }
+            else {
+                std::cout << "syscalls not counted\n";
+            }
+            if (threadCount == maxThreads) {
+                break;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Allocator that tracks the bytes currently allocated through it
+template<typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    static inline size_t allocated = 0;
+
+    CountingAllocator() = default;
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        CountingAllocator<char>::allocated += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        CountingAllocator<char>::allocated -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<typename U>
+    bool operator==(const CountingAllocator<U>&) const noexcept { return true; }
+};
+
+// Group `digests` in a map keyed by Key, as the scan does once every file is hashed.
+// Files are represented by their index so that only the cost of the key is compared.
+template<typename Key, typename Hash, typename MakeKey>
+void BenchGrouping(const char* name, const std::vector<Digest>& digests, MakeKey makeKey) {
+    using Files = std::vector<uint32_t, CountingAllocator<uint32_t>>;
+    using Map = std::unordered_map<Key, Files, Hash, std::equal_to<Key>, CountingAllocator<std::pair<const Key, Files>>>;
+
+    const size_t before = CountingAllocator<char>::allocated;
+    auto start = Clock::now();
+    {
+        Map map;
+        for (size_t i = 0; i < digests.size(); ++i) {
+            map[makeKey(digests[i])].push_back(static_cast<uint32_t>(i));
+        }
+        const double seconds = SecondsSince(start);
+        const size_t bytes = CountingAllocator<char>::allocated - before;
+
+        std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(3)
+            << seconds << " s, " << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MiB, "
+            << std::setprecision(1) << static_cast<double>(bytes) / digests.size() << " bytes/file, "
+            << map.size() << " groups\n";
+    }
+}
+
+// Memory and time of grouping by hex std::wstring keys compared to binary Digest keys
+int BenchDigest(const BenchOptions& options) {
+    // Every digest occurs twice, like a tree where each file has one duplicate
+    std::mt19937_64 random(42);
+    std::vector<Digest> digests(static_cast<size_t>(options.files));
+    for (size_t i = 0; i < digests.size(); i += 2) {
+        for (size_t j = 0; j < Digest::max_size; j += sizeof(uint64_t)) {
+            uint64_t value = random();
+            std::memcpy(&digests[i].bytes[j], &value, sizeof(value));
+        }
+        if (i + 1 < digests.size()) {
+            digests[i + 1] = digests[i];
+        }
+    }
+    std::shuffle(digests.begin(), digests.end(), random);
+    std::cout << "files: " << options.files << '\n';
+
+    using HexString = std::basic_string<wchar_t, std::char_traits<wchar_t>, CountingAllocator<wchar_t>>;
+    struct HexStringHash {
+        size_t operator()(const HexString& hex) const noexcept {
+            return std::hash<std::wstring_view>()(hex);
+        }
+    };
+    BenchGrouping<HexString, HexStringHash>("hex wstring", digests, [](const Digest& digest) {
+        auto hex = hash_to_wstring(digest);
+        return HexString(hex.begin(), hex.end());
+        });
+    BenchGrouping<Digest, DigestHash>("binary digest", digests, [](const Digest& digest) {
+        return digest;
+        });
+
+    return EXIT_SUCCESS;
+}
+
+// In-memory throughput of every hash backend compiled into this build
+int BenchHashers(const BenchOptions& options) {
+    std::mt19937_64 random(42);
+    std::vector<unsigned char> buffer(static_cast<size_t>(options.file_size));
+    for (size_t j = 0; j + sizeof(uint64_t) <= buffer.size(); j += sizeof(uint64_t)) {
+        uint64_t value = random();
+        std::memcpy(&buffer[j], &value, sizeof(value));
+    }
+    std::cout << "buffer size: " << buffer.size() << " bytes\n";
+
+    // Feed the buffer in the chunk size compute_file_hash reads with
+    constexpr size_t chunk_size = 8192;
+    for (HashAlgorithm algorithm : hash_algorithms()) {
+        if (!is_hash_algorithm_available(algorithm)) {
+            std::cout << std::left << std::setw(10) << hash_algorithm_name(algorithm) << "not available\n";
+            continue;
+        }
+
+        auto hasher = create_hasher(algorithm);
+        double best = 0;
+        Digest digest;
+        for (unsigned run = 0; run < options.repeat; ++run) {
+            auto start = Clock::now();
+            for (size_t offset = 0; offset < buffer.size(); offset += chunk_size) {
+                hasher->Update(buffer.data() + offset, std::min(chunk_size, buffer.size() - offset));
+            }
+            digest = hasher->Final();
+            double seconds = SecondsSince(start);
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+
+        std::cout << std::left << std::setw(10) << hash_algorithm_name(algorithm) << std::right << std::fixed
+            << std::setprecision(1) << MiBPerSecond(buffer.size(), best) << " MiB/s, "
+            << hash_to_string(digest) << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Files per second of small-file full hashing: one compute_file_hash call per file against
+// compute_file_hashes batches, then the SHA-256 batch kernels on the same contents in memory
+int BenchBatch(const BenchOptions& options) {
+    CreateDuplicatePairs(options.dir, options.files, options.file_size);
+    std::vector<fs::path> paths;
+    for (uintmax_t i = 0; i < options.files; ++i) {
+        paths.push_back(options.dir / ("file" + std::to_string(i)));
+    }
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes\n";
+
+    const auto report = [&](const std::string& name, double seconds) {
+        std::cout << std::left << std::setw(30) << name << std::right << std::fixed << std::setprecision(3)
+            << seconds << " s, " << std::setprecision(0) << (seconds > 0 ? options.files / seconds : 0.0) << " files/s, "
+            << std::setprecision(1) << MiBPerSecond(options.files * options.file_size, seconds) << " MiB/s\n";
+    };
+
+    const auto best_of = [&](auto run) {
+        double best = 0;
+        for (unsigned i = 0; i < options.repeat; ++i) {
+            auto start = Clock::now();
+            run();
+            double seconds = SecondsSince(start);
+            best = i == 0 ? seconds : std::min(best, seconds);
+        }
+        return best;
+    };
+
+    std::vector<Digest> reference(paths.size());
+    report("compute_file_hash", best_of([&] {
+        for (size_t i = 0; i < paths.size(); ++i) {
+            reference[i] = compute_file_hash(paths[i]);
+        }
+        }));
+
+    const size_t batch_files = ScanOptions().batch_hash_files;
+    bool identical = true;
+    report(std::string("compute_file_hashes (") + sha256_batch_kernel_name(sha256_batch_default_kernel()) + ")", best_of([&] {
+        for (size_t first = 0; first < paths.size(); first += batch_files) {
+            std::vector<fs::path> batch(paths.begin() + first, paths.begin() + std::min(paths.size(), first + batch_files));
+            auto results = compute_file_hashes(batch);
+            for (size_t i = 0; i < results.size(); ++i) {
+                identical = identical && results[i].error.empty() && results[i].hash == reference[first + i];
+            }
+        }
+        }));
+
+    // Kernels alone, without the reads
+    std::vector<std::vector<unsigned char>> contents;
+    for (const auto& path : paths) {
+        std::ifstream file(path, std::ios::binary);
+        contents.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    std::vector<const unsigned char*> messages;
+    std::vector<size_t> sizes;
+    for (const auto& content : contents) {
+        messages.push_back(content.data());
+        sizes.push_back(content.size());
+    }
+    for (Sha256BatchKernel kernel : { Sha256BatchKernel::Scalar, Sha256BatchKernel::Avx2 }) {
+        if (!is_sha256_batch_kernel_supported(kernel)) {
+            std::cout << std::left << std::setw(30) << std::string("kernel ") + sha256_batch_kernel_name(kernel) << "not supported\n";
+            continue;
+        }
+        std::vector<Digest> digests(messages.size());
+        report(std::string("kernel ") + sha256_batch_kernel_name(kernel), best_of([&] {
+            for (size_t first = 0; first < messages.size(); first += batch_files) {
+                const size_t count = std::min(batch_files, messages.size() - first);
+                sha256_batch(&messages[first], &sizes[first], count, &digests[first], kernel);
+            }
+            }));
+        identical = identical && digests == reference;
+    }
+
+    if (!identical) {
+        std::cerr << "Batch hashes differ from compute_file_hash\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Stream reads against memory-mapped windows for full hashes of growing file sizes, up to --size.
+// The same file is hashed repeatedly, so this measures the read path on a warm page cache.
+int BenchMmap(const BenchOptions& options) {
+    fs::create_directories(options.dir);
+    const fs::path path = options.dir / "mmap";
+    std::cout << "file size    stream MiB/s    mmap MiB/s\n";
+
+    for (uintmax_t size = 4096; size <= options.file_size; size *= 4) {
+        CreateDuplicatePairs(options.dir, 1, size);
+        fs::rename(options.dir / "file0", path);
+
+        // Hash at least 256 MiB per measurement so the small sizes are not dominated by timer noise
+        const uintmax_t passes = std::max<uintmax_t>(1, (256 * 1024 * 1024) / size);
+        const auto measure = [&](uintmax_t threshold) {
+            double best = 0;
+            Digest digest;
+            for (unsigned run = 0; run < options.repeat; ++run) {
+                auto start = Clock::now();
+                for (uintmax_t i = 0; i < passes; ++i) {
+                    digest = compute_file_hash(path, HashAlgorithm::Sha256, threshold);
+                }
+                double seconds = SecondsSince(start);
+                best = run == 0 ? seconds : std::min(best, seconds);
+            }
+            return std::make_pair(MiBPerSecond(size * passes, best), digest);
+        };
+
+        const auto [stream, streamDigest] = measure(0);
+        const auto [mapped, mappedDigest] = measure(1);
+        if (streamDigest != mappedDigest) {
+            std::cerr << "Mapped hash differs from the stream hash for " << size << " bytes\n";
+            return EXIT_FAILURE;
+        }
+
+        std::cout << std::right << std::setw(12) << size << std::fixed << std::setprecision(1)
+            << std::setw(15) << stream << std::setw(14) << mapped << (mapped > stream ? "  mmap" : "  stream") << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Drop the cached pages of every file so that the next run reads from the device. Only possible
+// on Linux; elsewhere the runs after the first one measure the page cache.
+void EvictFromPageCache(const std::vector<fs::path>& paths) {
+#ifdef __linux__
+    for (const auto& path : paths) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ::fdatasync(fd);
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+    }
+#else
+    (void)paths;
+#endif
+}
+
+// Blocking reads on the worker pool against io_uring at several queue depths, cold cache
+int BenchUring(const BenchOptions& options) {
+    CreateDuplicatePairs(options.dir, options.files, options.file_size);
+    std::vector<fs::path> paths;
+    for (uintmax_t i = 0; i < options.files; ++i) {
+        paths.push_back(options.dir / ("file" + std::to_string(i)));
+    }
+    const uintmax_t total = options.files * options.file_size;
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes\n";
+
+    ThreadPool pool(options.threads);
+    const auto measure = [&](const char* name, unsigned depth, auto run) {
+        double best = 0;
+        std::vector<Digest> digests;
+        for (unsigned i = 0; i < options.repeat; ++i) {
+            EvictFromPageCache(paths);
+            auto start = Clock::now();
+            digests = run();
+            double seconds = SecondsSince(start);
+            best = i == 0 ? seconds : std::min(best, seconds);
+        }
+        std::cout << std::left << std::setw(10) << name << std::right << std::setw(6);
+        if (depth > 0) {
+            std::cout << depth;
+        }
+        else {
+            std::cout << pool.GetThreadCount();
+        }
+        std::cout << std::fixed << std::setprecision(3) << std::setw(9) << best << " s"
+            << std::setprecision(1) << std::setw(10) << MiBPerSecond(total, best) << " MiB/s\n";
+        return digests;
+    };
+
+    std::cout << "path       depth     time      throughput\n";
+    const auto reference = measure("blocking", 0, [&] {
+        std::vector<Digest> digests(paths.size());
+        for (size_t i = 0; i < paths.size(); ++i) {
+            pool.Submit([&, i] { digests[i] = compute_file_hash(paths[i], HashAlgorithm::Sha256, 0); });
+        }
+        pool.Wait();
+        return digests;
+        });
+
+    if (!is_uring_available()) {
+        std::cout << "io_uring is not available\n";
+        return EXIT_SUCCESS;
+    }
+
+    for (unsigned depth : { 1u, 4u, 16u, 64u, 128u }) {
+        const auto digests = measure("io_uring", depth, [&] {
+            auto results = compute_file_hashes_uring(paths, HashAlgorithm::Sha256, depth, pool);
+            std::vector<Digest> digests;
+            for (const auto& result : results) {
+                digests.push_back(result.hash);
+            }
+            return digests;
+            });
+        if (digests != reference) {
+            std::cerr << "io_uring hashes differ from the blocking path at depth " << depth << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Full hashing against lockstep comparison of the final pass, cold cache. Half of the pairs are
+// duplicates; the other half differ in one byte a quarter into the file, which the partial passes
+// can't see, so hashing reads them whole while comparison stops there.
+int BenchCompare(const BenchOptions& options) {
+    CreateDuplicatePairs(options.dir, options.files, options.file_size);
+    std::vector<fs::path> paths;
+    for (uintmax_t i = 0; i < options.files; ++i) {
+        paths.push_back(options.dir / ("file" + std::to_string(i)));
+    }
+    for (uintmax_t i = 1; i < options.files; i += 4) {
+        std::fstream file(paths[i], std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(static_cast<std::streamoff>(options.file_size / 4));
+        file.put('\xff' ^ static_cast<char>(file.peek()));
+    }
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes\n";
+
+    std::map<std::string, std::vector<fs::path>> reference;
+    std::cout << "mode       time      final pass read\n";
+    for (FullPassMode mode : { FullPassMode::Hash, FullPassMode::Compare }) {
+        ScanOptions scanOptions;
+        scanOptions.thread_count = options.threads;
+        scanOptions.full_pass_mode = mode;
+
+        double best = 0;
+        ScanSummary summary;
+        DuplicateMap duplicates;
+        for (unsigned run = 0; run < options.repeat; ++run) {
+            EvictFromPageCache(paths);
+            auto start = Clock::now();
+            duplicates = find_duplicate_files({ options.dir }, scanOptions, summary);
+            double seconds = SecondsSince(start);
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+
+        auto normalized = Normalize(duplicates);
+        if (mode == FullPassMode::Hash) {
+            reference = std::move(normalized);
+        }
+        else if (normalized != reference) {
+            std::cerr << "Comparison found different duplicates than hashing\n";
+            return EXIT_FAILURE;
+        }
+
+        std::cout << std::left << std::setw(8) << (mode == FullPassMode::Hash ? "hash" : "compare") << std::right
+            << std::fixed << std::setprecision(3) << std::setw(8) << best << " s"
+            << std::setw(16) << summary.full_hash_bytes + summary.compared_bytes << " bytes\n";
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Reads in traversal order against reads sorted by physical offset, cold cache. The files are
+// written in name order, which the directory listing scatters, so the traversal order jumps
+// around the disk. The seek distance shows the saving on a rotational disk even where the scratch
+// directory is on flash, and the time only differs much on a hard disk.
+int BenchReadOrder(const BenchOptions& options) {
+    CreateDuplicatePairs(options.dir, options.files, options.file_size);
+    std::vector<fs::path> paths;
+    for (uintmax_t i = 0; i < options.files; ++i) {
+        paths.push_back(options.dir / ("file" + std::to_string(i)));
+    }
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes\n";
+
+    std::map<std::string, std::vector<fs::path>> reference;
+    std::cout << "order          time      seeks   average seek distance\n";
+    for (ReadOrder order : { ReadOrder::Traversal, ReadOrder::PhysicalOffset }) {
+        ScanOptions scanOptions;
+        scanOptions.thread_count = options.threads;
+        scanOptions.read_order = order;
+        scanOptions.measure_seek_distance = true;
+
+        double best = 0;
+        ScanSummary summary;
+        DuplicateMap duplicates;
+        for (unsigned run = 0; run < options.repeat; ++run) {
+            EvictFromPageCache(paths);
+            auto start = Clock::now();
+            duplicates = find_duplicate_files({ options.dir }, scanOptions, summary);
+            double seconds = SecondsSince(start);
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+
+        auto normalized = Normalize(duplicates);
+        if (order == ReadOrder::Traversal) {
+            reference = std::move(normalized);
+        }
+        else if (normalized != reference) {
+            std::cerr << "Ordered reads found different duplicates than traversal order\n";
+            return EXIT_FAILURE;
+        }
+
+        std::cout << std::left << std::setw(12) << (order == ReadOrder::Traversal ? "traversal" : "physical") << std::right
+            << std::fixed << std::setprecision(3) << std::setw(8) << best << " s" << std::setw(10) << summary.seek_count
+            << std::setw(16) << (summary.seek_count > 0 ? summary.seek_distance / summary.seek_count : 0) << " bytes\n";
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Page cache held by the whole system, from /proc/meminfo; 0 where it can't be read
+uintmax_t CachedBytes() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string name;
+    uintmax_t kib = 0;
+    std::string unit;
+    while (meminfo >> name >> kib >> unit) {
+        if (name == "Cached:") {
+            return kib * 1024;
+        }
+    }
+    return 0;
+}
+
+// Scan with and without background reads from a cold cache, reporting how much the page cache
+// grew and how many files got a new access time. The access times are set back a day before every
+// run, which makes relatime update them on the next read.
+int BenchPageCache(const BenchOptions& options) {
+    CreateDuplicatePairs(options.dir, options.files, options.file_size);
+    std::vector<fs::path> paths;
+    for (uintmax_t i = 0; i < options.files; ++i) {
+        paths.push_back(options.dir / ("file" + std::to_string(i)));
+    }
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes\n";
+
+    std::map<std::string, std::vector<fs::path>> reference;
+    std::cout << "mode          time   cache growth   atime updates\n";
+    for (ReadMode mode : { ReadMode::Normal, ReadMode::Background }) {
+        ScanOptions scanOptions;
+        scanOptions.thread_count = options.threads;
+        scanOptions.read_mode = mode;
+
+        EvictFromPageCache(paths);
+        std::vector<int64_t> atimes;
+#ifdef __linux__
+        for (const auto& path : paths) {
+            struct stat st;
+            ::stat(path.c_str(), &st);
+            const timespec times[2] = { { st.st_mtim.tv_sec - 24 * 60 * 60, 0 }, { 0, UTIME_OMIT } };
+            ::utimensat(AT_FDCWD, path.c_str(), times, 0);
+            atimes.push_back(st.st_mtim.tv_sec - 24 * 60 * 60);
+        }
+#endif
+
+        const uintmax_t cachedBefore = CachedBytes();
+        auto start = Clock::now();
+        ScanSummary summary;
+        auto duplicates = find_duplicate_files({ options.dir }, scanOptions, summary);
+        const double seconds = SecondsSince(start);
+        const uintmax_t cachedAfter = CachedBytes();
+
+        uintmax_t touched = 0;
+#ifdef __linux__
+        for (size_t i = 0; i < paths.size(); ++i) {
+            struct stat st;
+            if (::stat(paths[i].c_str(), &st) == 0 && st.st_atim.tv_sec != atimes[i]) {
+                ++touched;
+            }
+        }
+#endif
+
+        auto normalized = Normalize(duplicates);
+        if (mode == ReadMode::Normal) {
+            reference = std::move(normalized);
+        }
+        else if (normalized != reference) {
+            std::cerr << "Background reads found different duplicates than normal reads\n";
+            return EXIT_FAILURE;
+        }
+
+        const double growth = (static_cast<double>(cachedAfter) - static_cast<double>(cachedBefore)) / (1024.0 * 1024.0);
+        std::cout << std::left << std::setw(11) << (mode == ReadMode::Normal ? "normal" : "background") << std::right
+            << std::fixed << std::setprecision(3) << std::setw(6) << seconds << " s" << std::setprecision(1) << std::setw(11)
+            << growth << " MiB" << std::setw(16) << touched << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Rate a throttled scan achieves against its target, warm cache. The first run limits bytes, the
+// second operations; the third halves the byte limit halfway through to check that a change
+// applies while the scan runs. Every phase reports the rate from the throttle's counters and
+// fails the benchmark when it is off its target by more than throttle_tolerance.
+int BenchThrottle(const BenchOptions& options) {
+    // Largest relative deviation of an achieved rate from its target
+    constexpr double throttle_tolerance = 0.1;
+
+    CreateDuplicatePairs(options.dir, options.files, options.file_size);
+    const uintmax_t total = options.files * options.file_size;
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes\n";
+
+    // Aim for about two seconds per run, whatever the data size
+    const uint64_t byteRate = std::max<uint64_t>(total / 2, 1);
+    std::cout << "limit                 target      achieved   deviation\n";
+    bool withinTolerance = true;
+    const auto report = [&](const char* name, double target, double achieved) {
+        const double deviation = (achieved - target) / target;
+        const bool within = std::abs(deviation) <= throttle_tolerance;
+        withinTolerance = withinTolerance && within;
+        std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(0)
+            << std::setw(12) << target << std::setw(14) << achieved << std::setprecision(2) << std::setw(10)
+            << deviation * 100 << " %" << (within ? "" : "  out of tolerance") << '\n';
+    };
+
+    // The scan runs on its own thread while this one samples the counters
+    const auto scan = [&](IoThrottle& throttle, const std::function<void(double)>& onProgress) {
+        ScanOptions scanOptions;
+        scanOptions.thread_count = options.threads;
+        scanOptions.throttle = &throttle;
+        // Reads of the full pass then go through the workers rather than a single io_uring
+        scanOptions.io_queue_depth = 0;
+        ScanSummary summary;
+        std::atomic<bool> done = false;
+        std::thread worker([&] {
+            find_duplicate_files({ options.dir }, scanOptions, summary);
+            done = true;
+        });
+        const auto start = Clock::now();
+        while (!done) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            onProgress(SecondsSince(start));
+        }
+        worker.join();
+    };
+
+    {
+        IoThrottle throttle(byteRate, 0);
+        const auto start = Clock::now();
+        scan(throttle, [](double) {});
+        report("bytes/s", static_cast<double>(byteRate), throttle.GetBytesAcquired() / SecondsSince(start));
+    }
+    {
+        // Stream reads of 8 KiB and mapped slices of 1 MiB make for a mix of operation sizes
+        IoThrottle counter;
+        scan(counter, [](double) {});
+        const uint64_t operationRate = std::max<uint64_t>(counter.GetOperationsAcquired() / 2, 1);
+        IoThrottle throttle(0, operationRate);
+        const auto start = Clock::now();
+        scan(throttle, [](double) {});
+        report("operations/s", static_cast<double>(operationRate), throttle.GetOperationsAcquired() / SecondsSince(start));
+    }
+    {
+        IoThrottle throttle(byteRate * 2, 0);
+        uint64_t bytesAtChange = 0;
+        double secondsAtChange = 0;
+        const auto start = Clock::now();
+        scan(throttle, [&](double seconds) {
+            if (secondsAtChange == 0 && seconds >= 0.5) {
+                bytesAtChange = throttle.GetBytesAcquired();
+                secondsAtChange = seconds;
+                throttle.SetLimits(byteRate / 2, 0);
+            }
+        });
+        const double seconds = SecondsSince(start);
+        if (secondsAtChange == 0 || seconds <= secondsAtChange) {
+            std::cout << "the scan ended before the limit change\n";
+            withinTolerance = false;
+        }
+        else {
+            report("bytes/s before", static_cast<double>(byteRate * 2), bytesAtChange / secondsAtChange);
+            report("bytes/s after", static_cast<double>(byteRate / 2), (throttle.GetBytesAcquired() - bytesAtChange) / (seconds - secondsAtChange));
+        }
+    }
+
+    std::cout << "tolerance: " << std::setprecision(0) << throttle_tolerance * 100 << " %\n";
+    return withinTolerance ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// A cold-cache scan next to another workload that streams a file of its own, once with reads at
+// full concurrency and once adapted to an I/O pressure ceiling. Reports the scan time, the stall
+// share during the scan and the throughput left to the other workload.
+int BenchPressure(const BenchOptions& options) {
+    const fs::path pressureFile = default_io_pressure_file();
+    if (pressureFile.empty()) {
+        std::cout << "I/O pressure information is not available\n";
+        return EXIT_SUCCESS;
+    }
+
+    CreateDuplicatePairs(options.dir / "scan", options.files, options.file_size);
+    std::vector<fs::path> paths;
+    for (uintmax_t i = 0; i < options.files; ++i) {
+        paths.push_back(options.dir / "scan" / ("file" + std::to_string(i)));
+    }
+    const fs::path other = options.dir / "other";
+    CreateDuplicatePairs(options.dir / "other", 1, options.files * options.file_size / 2);
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes, pressure file: " << pressureFile.string() << '\n';
+
+    std::cout << "ceiling      scan time   stall share   other workload   lowest limit\n";
+    for (double ceiling : { 0.0, 10.0 }) {
+        ScanOptions scanOptions;
+        scanOptions.thread_count = options.threads;
+        scanOptions.rotational_device_concurrency = 0;
+        scanOptions.io_pressure_ceiling = ceiling;
+        scanOptions.io_pressure_file = pressureFile;
+
+        EvictFromPageCache(paths);
+        std::atomic<bool> done = false;
+        uintmax_t otherBytes = 0;
+        std::thread workload([&] {
+            std::vector<char> buffer(1024 * 1024);
+            while (!done) {
+                EvictFromPageCache({ other / "file0" });
+                std::ifstream file(other / "file0", std::ios::binary);
+                while (!done && file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+                    otherBytes += buffer.size();
+                }
+            }
+        });
+
+        IoPressure before;
+        IoPressure after;
+        read_io_pressure(pressureFile, before);
+        ScanSummary summary;
+        const auto start = Clock::now();
+        find_duplicate_files({ options.dir / "scan" }, scanOptions, summary);
+        const double seconds = SecondsSince(start);
+        read_io_pressure(pressureFile, after);
+        done = true;
+        workload.join();
+
+        const double stall = (after.total_us - before.total_us) / (seconds * 1e6) * 100;
+        std::cout << std::left << std::setw(10) << (ceiling > 0 ? std::to_string(static_cast<int>(ceiling)) + " %" : "none") << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10) << seconds << " s" << std::setprecision(1) << std::setw(12) << stall
+            << " %" << std::setw(12) << MiBPerSecond(otherBytes, seconds) << " MiB/s" << std::setw(15)
+            << (ceiling > 0 ? std::to_string(summary.lowest_read_limit) : "-") << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Clone every even file onto the odd one after it, so the pairs share all extents. Returns false
+// when the file system of dir has no reflinks, or off Linux.
+bool CloneDuplicatePairs(const fs::path& dir, uintmax_t count) {
+#ifdef __linux__
+    for (uintmax_t i = 0; i + 1 < count; i += 2) {
+        const int source = ::open((dir / ("file" + std::to_string(i))).c_str(), O_RDONLY);
+        const int target = ::open((dir / ("file" + std::to_string(i + 1))).c_str(), O_WRONLY | O_TRUNC);
+        const bool cloned = source >= 0 && target >= 0 && ::ioctl(target, FICLONE, source) == 0;
+        if (source >= 0) {
+            ::close(source);
+        }
+        if (target >= 0) {
+            ::close(target);
+        }
+        if (!cloned) {
+            return false;
+        }
+    }
+    return true;
+#else
+    (void)dir;
+    (void)count;
+    return false;
+#endif
+}
+
+// Scan of reflinked pairs with and without the shared extent check, cold cache. Point --dir at a
+// btrfs or XFS file system, e.g. a loopback image, since elsewhere nothing can be cloned.
+int BenchSharedExtents(const BenchOptions& options) {
+    CreateDuplicatePairs(options.dir, options.files, options.file_size);
+    if (!CloneDuplicatePairs(options.dir, options.files)) {
+        std::cout << "reflinks are not supported in " << options.dir.string() << '\n';
+        return EXIT_SUCCESS;
+    }
+    std::vector<fs::path> paths;
+    for (uintmax_t i = 0; i < options.files; ++i) {
+        paths.push_back(options.dir / ("file" + std::to_string(i)));
+    }
+    std::cout << "files: " << options.files << ", file size: " << options.file_size << " bytes\n";
+
+    std::cout << "extent check   time     bytes read   shared sets\n";
+    for (bool detect : { false, true }) {
+        ScanOptions scanOptions;
+        scanOptions.thread_count = options.threads;
+        scanOptions.detect_shared_extents = detect;
+
+        double best = 0;
+        ScanSummary summary;
+        for (unsigned run = 0; run < options.repeat; ++run) {
+            EvictFromPageCache(paths);
+            auto start = Clock::now();
+            find_duplicate_files({ options.dir }, scanOptions, summary);
+            double seconds = SecondsSince(start);
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+
+        const uintmax_t bytes = summary.head_tail_bytes + summary.middle_bytes + summary.full_hash_bytes;
+        std::cout << std::left << std::setw(10) << (detect ? "on" : "off") << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << best << " s" << std::setw(15) << bytes << std::setw(14) << summary.shared_extent_sets.size() << '\n';
+        if (detect && summary.shared_extent_files != options.files / 2) {
+            std::cerr << "Expected " << options.files / 2 << " files sharing extents, found " << summary.shared_extent_files << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Hash of every byte of a file as read through the stream, holes included, the way
+// compute_file_hash read files before it knew about holes
+Digest HashDense(const fs::path& path, HashAlgorithm algorithm) {
+    auto hasher = create_hasher(algorithm);
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> buffer(64 * 1024);
+    while (file.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || file.gcount() > 0) {
+        hasher->Update(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    return hasher->Final();
+}
+
+// Dense against hole-skipping full hashes of one sparse file of --size bytes with 1 MiB of data
+// every GiB (16 data segments for smaller sizes). Try --size 107374182400 for 100 GB.
+int BenchSparse(const BenchOptions& options) {
+    fs::create_directories(options.dir);
+    const fs::path path = options.dir / "sparse";
+    {
+        std::ofstream file(path, std::ios::binary);
+        constexpr uintmax_t segment_size = 1024 * 1024;
+        const uintmax_t stride = std::max<uintmax_t>(std::min<uintmax_t>(1024 * 1024 * 1024, options.file_size / 16), segment_size);
+        std::mt19937_64 random(42);
+        std::vector<char> segment(segment_size);
+        for (uintmax_t offset = 0; offset + segment_size <= options.file_size; offset += stride) {
+            for (size_t j = 0; j + sizeof(uint64_t) <= segment.size(); j += sizeof(uint64_t)) {
+                uint64_t value = random();
+                std::memcpy(&segment[j], &value, sizeof(value));
+            }
+            file.seekp(static_cast<std::streamoff>(offset));
+            file.write(segment.data(), static_cast<std::streamsize>(segment.size()));
+        }
+    }
+    fs::resize_file(path, options.file_size);
+
+    std::cout << "file size: " << options.file_size << " bytes, " << (is_sparse_file(path) ? "sparse" : "not sparse on this file system") << '\n';
+    std::cout << "algorithm  dense         skipping holes\n";
+    for (HashAlgorithm algorithm : hash_algorithms()) {
+        if (!is_hash_algorithm_available(algorithm)) {
+            continue;
+        }
+
+        const auto measure = [&](auto run) {
+            double best = 0;
+            Digest digest;
+            for (unsigned i = 0; i < options.repeat; ++i) {
+                auto start = Clock::now();
+                digest = run();
+                double seconds = SecondsSince(start);
+                best = i == 0 ? seconds : std::min(best, seconds);
+            }
+            return std::make_pair(best, digest);
+        };
+        const auto [dense, denseDigest] = measure([&] { return HashDense(path, algorithm); });
+        const auto [sparse, sparseDigest] = measure([&] { return compute_file_hash(path, algorithm); });
+        if (denseDigest != sparseDigest) {
+            std::cerr << "Hole-skipping hash differs from the dense hash with " << hash_algorithm_name(algorithm) << '\n';
+            return EXIT_FAILURE;
+        }
+
+        std::cout << std::left << std::setw(10) << hash_algorithm_name(algorithm) << std::right << std::fixed << std::setprecision(3)
+            << std::setw(8) << dense << " s" << std::setw(13) << sparse << " s\n";
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// A "Hashing completed" line for each of --files paths from --threads producers, once formatted
+// and handed to the log callback one by one and once posted to the log pipeline. The callback
+// appends to one string under a lock, as the GUI's does. No file is created; try --files 1000000.
+int BenchLog(const BenchOptions& options) {
+    const unsigned threads = options.threads ? options.threads : ThreadPool::DefaultThreadCount();
+    std::vector<fs::path> paths;
+    paths.reserve(options.files);
+    for (uintmax_t i = 0; i < options.files; ++i) {
+        paths.push_back(options.dir / ("dir" + std::to_string(i / 64)) / ("file" + std::to_string(i % 64)));
+    }
+    std::cout << "files: " << options.files << ", producers: " << threads << ", compiled log level: "
+        << static_cast<int>(compiled_log_level) << '\n';
+    std::cout << "log         producers      total   callbacks\n";
+
+    // Every producer takes the paths of its own stride
+    const auto produce = [&](const std::function<void(const fs::path&)>& post) {
+        std::vector<std::thread> producers;
+        for (unsigned t = 0; t < threads; ++t) {
+            producers.emplace_back([&, t] {
+                for (size_t i = t; i < paths.size(); i += threads) {
+                    post(paths[i]);
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+    };
+
+    size_t reference = 0;
+    for (bool pipeline : { false, true }) {
+        double bestProducers = 0;
+        double bestTotal = 0;
+        uint64_t callbacks = 0;
+        for (unsigned run = 0; run < options.repeat; ++run) {
+            std::mutex mutex;
+            std::wstring log;
+            callbacks = 0;
+            const LogCallback callback = [&](std::wstring text) {
+                std::lock_guard<std::mutex> lock(mutex);
+                log += text;
+                ++callbacks;
+            };
+
+            double producerSeconds = 0;
+            const auto start = Clock::now();
+            if (pipeline) {
+                LogPipeline logger(callback);
+                produce([&](const fs::path& path) {
+                    if constexpr (is_log_enabled(LogLevel::Debug)) {
+                        logger.Post({ LogLevel::Debug, LogEvent::FileHashed, path, {} });
+                    }
+                    });
+                producerSeconds = SecondsSince(start);
+            }
+            else {
+                produce([&](const fs::path& path) {
+                    callback(L"Hashing completed: " + path_to_wstring(path) + L"\r\n");
+                    });
+                producerSeconds = SecondsSince(start);
+            }
+            const double totalSeconds = SecondsSince(start);
+            bestProducers = run == 0 ? producerSeconds : std::min(bestProducers, producerSeconds);
+            bestTotal = run == 0 ? totalSeconds : std::min(bestTotal, totalSeconds);
+
+            if (!pipeline) {
+                reference = log.size();
+            }
+            else if (is_log_enabled(LogLevel::Debug) && log.size() != reference) {
+                std::cerr << "The pipeline logged " << log.size() << " characters instead of " << reference << '\n';
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::cout << std::left << std::setw(10) << (pipeline ? "pipeline" : "callback") << std::right << std::fixed << std::setprecision(3)
+            << std::setw(9) << bestProducers << " s" << std::setw(9) << bestTotal << " s" << std::setw(12) << callbacks << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
+
+struct Benchmark {
+    const char* name;
+    const char* description;
+    std::function<int(const BenchOptions&)> run;
+};
+
+const std::vector<Benchmark>& Benchmarks() {
+    static const std::vector<Benchmark> benchmarks = {
+        { "threads", "single-threaded scan vs the hashing worker pool", BenchThreads },
+        { "traversal", "std::filesystem vs getdents64 walk with 1..N threads (try --files 5000000)", BenchTraversal },
+        { "digest", "grouping by hex string vs binary digest keys (uses --files)", BenchDigest },
+        { "hashers", "in-memory throughput of every hash backend (uses --size)", BenchHashers },
+        { "mmap", "stream vs memory-mapped full hashing from 4 KiB up to --size", BenchMmap },
+        { "uring", "blocking reads vs io_uring at queue depths 1..128, cold cache", BenchUring },
+        { "compare", "full hashing vs lockstep comparison of the final pass, cold cache", BenchCompare },
+        { "hddorder", "reads in traversal order vs sorted by physical offset, with the seek distance, cold cache", BenchReadOrder },
+        { "pagecache", "page cache growth and access time updates with and without background reads", BenchPageCache },
+        { "throttle", "achieved vs target rate of a throttled scan, including a limit change mid-scan", BenchThrottle },
+        { "pressure", "cold scan next to a streaming workload, with and without an I/O pressure ceiling", BenchPressure },
+        { "reflinks", "scan of reflinked pairs with and without the shared extent check (needs --dir on btrfs/XFS)", BenchSharedExtents },
+        { "sparse", "dense vs hole-skipping full hash of one sparse file of --size bytes", BenchSparse },
+        { "batch", "per-file vs batched SHA-256 of small files (try --files 65536 --size 16384)", BenchBatch },
+        { "log", "per-file log callback vs the batched log pipeline (try --files 1000000)", BenchLog },
+    };
+    return benchmarks;
+}
+
+void PrintUsage(std::ostream& out) {
+    out << "Usage: dupfinder-bench <benchmark> [options]\n"
+        "\n"
+        "Benchmarks:\n";
+    for (const auto& benchmark : Benchmarks()) {
+        out << "  " << std::left << std::setw(12) << benchmark.name << benchmark.description << '\n';
+    }
+    out << "\n"
+        "Options:\n"
+        "  --dir <path>      scratch directory for generated data (default: a temporary directory)\n"
+        "  --files <count>   number of generated files (default 256)\n"
+        "  --size <bytes>    size of every generated file (default 4194304)\n"
+        "  --threads <count> worker threads, 0 uses one per hardware thread (default 0)\n"
+        "  --repeat <count>  runs per configuration, the best one is reported (default 3)\n";
+}
+
+uintmax_t ParseNumber(const std::string& option, const char* value) {
+    if (!value) {
+        throw std::invalid_argument("Missing value for " + option);
+    }
+
+    char* end = nullptr;
+    unsigned long long result = std::strtoull(value, &end, 10);
+    if (*value == '\0' || *value == '-' || *end != '\0') {
+        throw std::invalid_argument("Invalid value for " + option + ": " + value);
+    }
+    return static_cast<uintmax_t>(result);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage(std::cerr);
+        return 2;
+    }
+
+    const std::string name = argv[1];
+    auto benchmark = std::find_if(Benchmarks().begin(), Benchmarks().end(),
+        [&](const Benchmark& b) { return name == b.name; });
+    if (benchmark == Benchmarks().end()) {
+        PrintUsage(name == "-h" || name == "--help" ? std::cout : std::cerr);
+        return name == "-h" || name == "--help" ? EXIT_SUCCESS : 2;
+    }
+
+    BenchOptions options;
+    bool removeDir = false;
+    try {
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            const char* value = i + 1 < argc ? argv[++i] : nullptr;
+            if (arg == "--dir") {
+                if (!value) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                options.dir = value;
+            }
+            else if (arg == "--files") {
+                options.files = ParseNumber(arg, value);
+            }
+            else if (arg == "--size") {
+                options.file_size = ParseNumber(arg, value);
+            }
+            else if (arg == "--threads") {
+                options.threads = static_cast<unsigned>(ParseNumber(arg, value));
+            }
+            else if (arg == "--repeat") {
+                options.repeat = std::max<unsigned>(1, static_cast<unsigned>(ParseNumber(arg, value)));
+            }
+            else {
+                throw std::invalid_argument("Unknown option: " + arg);
+            }
+        }
+    }
+    catch (const std::invalid_argument& e) {
+        std::cerr << "dupfinder-bench: " << e.what() << "\n\n";
+        PrintUsage(std::cerr);
+        return 2;
+    }
+
+    if (options.dir.empty()) {
+        options.dir = fs::temp_directory_path() / ("dupfinder-bench-" + std::to_string(std::random_device()()));
+        removeDir = true;
+    }
+
+    int result = EXIT_FAILURE;
+    try {
+        result = benchmark->run(options);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "dupfinder-bench: " << e.what() << '\n';
+    }
+
+    if (removeDir) {
+        std::error_code ec;
+        fs::remove_all(options.dir, ec);
+    }
+
+    return result;
+}
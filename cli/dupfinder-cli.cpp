@@ -0,0 +1,449 @@
+#include "dedupe.h"
+#include "duplicates.h"
+#include "io_throttle.h"
+#include "scan_session.h"
+#include "text.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Set by SIGINT and SIGTERM; the main thread then cancels the scan, which saves its checkpoint
+volatile std::sig_atomic_t interrupted = 0;
+
+void OnInterrupt(int) {
+    interrupted = 1;
+}
+
+void PrintUsage(std::ostream& out) {
+    out << "Usage: dupfinder-cli [options] <root>...\n"
+        "\n"
+        "Finds duplicate files under the given roots and writes every group to stdout\n"
+        "as <algorithm>:<hash> followed by one path per line, groups separated by a blank line.\n"
+        "A file with several hard links takes part under its first path only.\n"
+        "\n"
+        "Options:\n"
+        "  --hash <algorithm>      sha256, sha1, blake3 or xxh3-128 (default sha256)\n"
+        "  --head-block <bytes>    bytes hashed from the start of a file in the first pass (default 4096)\n"
+        "  --tail-block <bytes>    bytes hashed from the end of a file in the first pass (default 4096)\n"
+        "  --middle-block <bytes>  bytes hashed from the middle of a file in the second pass,\n"
+        "                          0 disables the pass (default 65536)\n"
+        "  --batch-max <bytes>     files up to this size are hashed in batches, 0 disables batching\n"
+        "                          (default 65536)\n"
+        "  --mmap-threshold <bytes> files at least this large are hashed memory-mapped, 0 disables\n"
+        "                          mapping (default 1048576)\n"
+        "  --queue-depth <count>   io_uring reads in flight for full hashes, 0 uses blocking reads\n"
+        "                          (default 64)\n"
+        "  --compare               confirm small groups by comparing their files instead of hashing them\n"
+        "  --compare-limit <count> largest group confirmed by comparison with --compare (default 3)\n"
+        "  --cache <file>          persistent hash cache; unchanged files are not read again\n"
+        "  --checkpoint <file>     save the state of the scan to this file every --checkpoint-interval\n"
+        "                          and when interrupted, so that --resume can continue it\n"
+        "  --checkpoint-interval <seconds> time between checkpoints (default 60)\n"
+        "  --resume                continue the scan saved in the --checkpoint file\n"
+        "  -j, --threads <count>   hashing worker threads, 0 uses one per hardware thread (default 0)\n"
+        "  --device-limit <count>  reads of one device handed to the workers at a time, 0 for no limit\n"
+        "                          (default 0)\n"
+        "  --hdd-limit <count>     the same for rotational disks, 0 uses --device-limit (default 1)\n"
+        "  --walkers <count>       directory traversal threads, 0 uses one per hardware thread (default 0)\n"
+        "  --walker <backend>      how directories are listed: getdents (Linux, default there) or filesystem\n"
+        "  --read-order <order>    order of the reads of every pass: traversal (default) or physical,\n"
+        "                          which sorts files by their location on disk; for hard disks, with -j 1\n"
+        "  --background            Linux: read without updating access times where permitted, drop the\n"
+        "                          pages of every file from the page cache once it is hashed and read\n"
+        "                          ahead the next one, to spare other workloads on the machine\n"
+        "  --max-rate <bytes>      limit all reads together to this many bytes per second, 0 for no limit\n"
+        "  --max-iops <count>      limit all reads together to this many operations per second, counting\n"
+        "                          every buffer, mapped slice or io_uring read, 0 for no limit\n"
+        "  --io-pressure <percent> Linux: keep the I/O stall share (PSI \"some\") under this ceiling by\n"
+        "                          lowering and raising the reads at a time, 0 disables (default 0)\n"
+        "  --seek-stats            measure the distance between the disk locations of consecutive reads\n"
+        "  --hard-links            also write every set of hard links, headed by \"hardlinks\"\n"
+        "  --shared-extents        Linux: don't read files whose data is all shared with another\n"
+        "                          candidate (reflinks), and write those sets headed by \"sharedextents\"\n"
+        "  --dedupe <method>       make every file of a group share the storage of the first one:\n"
+        "                          reflink (FIDEDUPERANGE, Linux btrfs/XFS) or hardlink; actions go to stderr\n"
+        "  --dry-run               with --dedupe, report what would be done without changing anything\n"
+        "  -s, --summary           print the scan summary to stderr\n"
+        "  -v, --verbose           print the progress log to stderr\n"
+        "  --progress              print the counters of the scan and an estimate of the time left\n"
+        "                          to stderr every second\n"
+        "  -h, --help              show this help\n";
+}
+
+uintmax_t ParseSize(const std::string& option, const char* value) {
+    if (!value) {
+        throw std::invalid_argument("Missing value for " + option);
+    }
+
+    char* end = nullptr;
+    unsigned long long result = std::strtoull(value, &end, 10);
+    if (*value == '\0' || *value == '-' || *end != '\0') {
+        throw std::invalid_argument("Invalid value for " + option + ": " + value);
+    }
+    return static_cast<uintmax_t>(result);
+}
+
+void PrintLog(std::wstring message) {
+    // Log lines are terminated with CRLF for the Win32 edit control
+    message.erase(std::remove(message.begin(), message.end(), L'\r'), message.end());
+    std::cerr << convert_to_string(message);
+}
+
+const char* StageName(ScanStage stage) {
+    switch (stage) {
+    case ScanStage::Traversal:
+        return "traversal";
+    case ScanStage::HeadTail:
+        return "head/tail";
+    case ScanStage::Middle:
+        return "middle";
+    case ScanStage::Full:
+        return "full";
+    case ScanStage::Done:
+        return "done";
+    }
+    return "";
+}
+
+void PrintProgress(const ScanSnapshot& snapshot) {
+    std::cerr << "progress: " << StageName(snapshot.stage) << ", " << snapshot.entries_seen << " entries, "
+        << snapshot.candidate_files << " candidates, " << snapshot.bytes_read << " bytes read, "
+        << snapshot.groups_confirmed << " groups, " << std::fixed << std::setprecision(1) << snapshot.elapsed_seconds << " s";
+    if (snapshot.fraction >= 0) {
+        std::cerr << ", " << snapshot.fraction * 100 << "% done, " << snapshot.eta_seconds << " s left";
+    }
+    std::cerr << '\n';
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    ScanOptions options;
+    std::vector<fs::path> roots;
+    bool verbose = false;
+    bool summary = false;
+    bool hardLinks = false;
+    bool progress = false;
+    bool dedupe = false;
+    DedupeOptions dedupeOptions;
+    IoThrottle throttle;
+    uint64_t maxRate = 0;
+    uint64_t maxIops = 0;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-h" || arg == "--help") {
+                PrintUsage(std::cout);
+                return EXIT_SUCCESS;
+            }
+            else if (arg == "-v" || arg == "--verbose") {
+                verbose = true;
+            }
+            else if (arg == "-s" || arg == "--summary") {
+                summary = true;
+            }
+            else if (arg == "--progress") {
+                progress = true;
+            }
+            else if (arg == "--hard-links") {
+                hardLinks = true;
+            }
+            else if (arg == "--dedupe") {
+                const char* value = i + 1 < argc ? argv[++i] : nullptr;
+                if (!value) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                if (std::strcmp(value, "reflink") == 0) {
+                    dedupeOptions.method = DedupeMethod::Reflink;
+                }
+                else if (std::strcmp(value, "hardlink") == 0) {
+                    dedupeOptions.method = DedupeMethod::HardLink;
+                }
+                else {
+                    throw std::invalid_argument("Unknown dedupe method: " + std::string(value));
+                }
+                dedupe = true;
+            }
+            else if (arg == "--dry-run") {
+                dedupeOptions.dry_run = true;
+            }
+            else if (arg == "--read-order") {
+                const char* value = i + 1 < argc ? argv[++i] : nullptr;
+                if (!value) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                if (std::strcmp(value, "traversal") == 0) {
+                    options.read_order = ReadOrder::Traversal;
+                }
+                else if (std::strcmp(value, "physical") == 0) {
+                    options.read_order = ReadOrder::PhysicalOffset;
+                }
+                else {
+                    throw std::invalid_argument("Unknown read order: " + std::string(value));
+                }
+            }
+            else if (arg == "--background") {
+                options.read_mode = ReadMode::Background;
+            }
+            else if (arg == "--max-rate") {
+                maxRate = ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr);
+            }
+            else if (arg == "--max-iops") {
+                maxIops = ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr);
+            }
+            else if (arg == "--io-pressure") {
+                options.io_pressure_ceiling = static_cast<double>(ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr));
+            }
+            else if (arg == "--seek-stats") {
+                options.measure_seek_distance = true;
+            }
+            else if (arg == "--shared-extents") {
+                options.detect_shared_extents = true;
+            }
+            else if (arg == "-j" || arg == "--threads") {
+                options.thread_count = static_cast<unsigned>(ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr));
+            }
+            else if (arg == "--device-limit") {
+                options.device_concurrency = static_cast<unsigned>(ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr));
+            }
+            else if (arg == "--hdd-limit") {
+                options.rotational_device_concurrency = static_cast<unsigned>(ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr));
+            }
+            else if (arg == "--walkers") {
+                options.traversal_thread_count = static_cast<unsigned>(ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr));
+            }
+            else if (arg == "--walker") {
+                const char* value = i + 1 < argc ? argv[++i] : nullptr;
+                if (!value) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                if (std::strcmp(value, "getdents") == 0) {
+                    options.traversal_backend = TraversalBackend::Getdents;
+                }
+                else if (std::strcmp(value, "filesystem") == 0) {
+                    options.traversal_backend = TraversalBackend::Filesystem;
+                }
+                else {
+                    throw std::invalid_argument("Unknown traversal backend: " + std::string(value));
+                }
+            }
+            else if (arg == "--hash") {
+                const char* value = i + 1 < argc ? argv[++i] : nullptr;
+                if (!value) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                auto algorithm = parse_hash_algorithm(value);
+                if (!algorithm) {
+                    throw std::invalid_argument("Unknown hash algorithm: " + std::string(value));
+                }
+                if (!is_hash_algorithm_available(*algorithm)) {
+                    throw std::invalid_argument("Hash algorithm not available in this build: " + std::string(value));
+                }
+                options.hash_algorithm = *algorithm;
+            }
+            else if (arg == "--head-block") {
+                options.head_block_size = ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr);
+            }
+            else if (arg == "--tail-block") {
+                options.tail_block_size = ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr);
+            }
+            else if (arg == "--cache") {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                options.hash_cache_file = argv[++i];
+            }
+            else if (arg == "--checkpoint") {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                options.checkpoint_file = argv[++i];
+            }
+            else if (arg == "--checkpoint-interval") {
+                options.checkpoint_interval = std::chrono::seconds(ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr));
+            }
+            else if (arg == "--resume") {
+                options.resume = true;
+            }
+            else if (arg == "--mmap-threshold") {
+                options.mmap_threshold = ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr);
+            }
+            else if (arg == "--queue-depth") {
+                options.io_queue_depth = static_cast<unsigned>(ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr));
+            }
+            else if (arg == "--compare") {
+                options.full_pass_mode = FullPassMode::Compare;
+            }
+            else if (arg == "--compare-limit") {
+                options.compare_group_limit = static_cast<unsigned>(ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr));
+            }
+            else if (arg == "--batch-max") {
+                options.batch_hash_max_size = ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr);
+            }
+            else if (arg == "--middle-block") {
+                options.middle_block_size = ParseSize(arg, i + 1 < argc ? argv[++i] : nullptr);
+            }
+            else if (arg.size() > 1 && arg[0] == '-') {
+                throw std::invalid_argument("Unknown option: " + arg);
+            }
+            else {
+                roots.emplace_back(arg);
+            }
+        }
+
+        if (dedupeOptions.dry_run && !dedupe) {
+            throw std::invalid_argument("--dry-run needs --dedupe");
+        }
+        if (options.resume && options.checkpoint_file.empty()) {
+            throw std::invalid_argument("--resume needs --checkpoint");
+        }
+
+        if (roots.empty()) {
+            throw std::invalid_argument("No root directory given");
+        }
+
+        for (const auto& root : roots) {
+            std::error_code ec;
+            if (!fs::is_directory(root, ec)) {
+                throw std::invalid_argument("Not a directory: " + root.string());
+            }
+        }
+    }
+    catch (const std::invalid_argument& e) {
+        std::cerr << "dupfinder-cli: " << e.what() << "\n\n";
+        PrintUsage(std::cerr);
+        return 2;
+    }
+
+    if (maxRate > 0 || maxIops > 0) {
+        throttle.SetLimits(maxRate, maxIops);
+        options.throttle = &throttle;
+    }
+
+    try {
+        ScanSummary scanSummary;
+        std::signal(SIGINT, OnInterrupt);
+        std::signal(SIGTERM, OnInterrupt);
+        ScanSession session(roots, options, verbose ? LogCallback(PrintLog) : LogCallback([](std::wstring) {}));
+        auto lastProgress = std::chrono::steady_clock::now();
+        while (!session.WaitFor(std::chrono::milliseconds(100))) {
+            if (interrupted) {
+                session.Cancel();
+            }
+            if (progress && std::chrono::steady_clock::now() - lastProgress >= std::chrono::seconds(1)) {
+                PrintProgress(session.GetSnapshot());
+                lastProgress = std::chrono::steady_clock::now();
+            }
+        }
+        if (progress) {
+            PrintProgress(session.GetSnapshot());
+        }
+        auto duplicates = session.TakeResult(scanSummary);
+
+        for (const auto& [hash, files] : duplicates) {
+            std::cout << hash_algorithm_name(hash.algorithm) << ':' << hash_to_string(hash) << '\n';
+            for (const auto& file : files) {
+                std::cout << file.string() << '\n';
+            }
+            std::cout << '\n';
+        }
+
+        if (hardLinks) {
+            for (const auto& links : scanSummary.hard_link_sets) {
+                std::cout << "hardlinks\n";
+                for (const auto& file : links) {
+                    std::cout << file.string() << '\n';
+                }
+                std::cout << '\n';
+            }
+        }
+
+        for (const auto& sharers : scanSummary.shared_extent_sets) {
+            std::cout << "sharedextents\n";
+            for (const auto& file : sharers) {
+                std::cout << file.string() << '\n';
+            }
+            std::cout << '\n';
+        }
+
+        DedupeSummary dedupeSummary;
+        if (dedupe) {
+            dedupeOptions.thread_count = options.thread_count;
+            dedupeSummary = dedupe_duplicate_files(duplicates, dedupeOptions, PrintLog);
+        }
+
+        if (summary) {
+            std::cerr << "files seen:            " << scanSummary.files_seen << '\n'
+                << "size candidates:       " << scanSummary.candidate_files << '\n'
+                << "skipped by size:       " << scanSummary.files_skipped_by_size << " files, "
+                << scanSummary.bytes_skipped_by_size << " bytes\n"
+                << "head/tail pass:        " << scanSummary.head_tail_files << " files, "
+                << scanSummary.head_tail_bytes << " bytes read\n"
+                << "middle pass:           " << scanSummary.middle_files << " files, "
+                << scanSummary.middle_bytes << " bytes read\n"
+                << "full hash:             " << scanSummary.full_hash_files << " files, "
+                << scanSummary.full_hash_bytes << " bytes read\n"
+                << "compared:              " << scanSummary.compared_files << " files, "
+                << scanSummary.compared_bytes << " bytes read\n"
+                << "batch hashed:          " << scanSummary.batch_hashed_files << " files\n"
+                << "io_uring reads:        " << scanSummary.uring_files << " files\n"
+                << "hash cache:            " << scanSummary.cache_hits << " hits, "
+                << scanSummary.cache_misses << " misses\n"
+                << "duplicate groups:      " << duplicates.size() << '\n'
+                << "reclaimable:           " << scanSummary.reclaimable_bytes << " bytes\n"
+                << "hard links:            " << scanSummary.hard_link_sets.size() << " sets, "
+                << scanSummary.hard_link_files << " paths not read\n"
+                << "shared extents:        " << scanSummary.shared_extent_sets.size() << " sets, "
+                << scanSummary.shared_extent_files << " files not read\n"
+                << "hashing threads:       " << scanSummary.thread_count << '\n'
+                << "traversal threads:     " << scanSummary.traversal_thread_count << '\n';
+            for (const auto& device : scanSummary.devices) {
+                const double throughput = device.busy_seconds > 0 ? device.bytes_read / (1024.0 * 1024.0) / device.busy_seconds : 0.0;
+                std::cerr << "device " << std::left << std::setw(15) << device_to_string(device.device) + ":" << std::right
+                    << device.files << " reads, " << device.bytes_read << " bytes, " << std::fixed << std::setprecision(1)
+                    << throughput << " MiB/s, " << (device.concurrency ? std::to_string(device.concurrency) : "unlimited")
+                    << (device.rotational ? " at a time (rotational)\n" : " at a time\n");
+            }
+            if (options.io_pressure_ceiling > 0) {
+                std::cerr << "io pressure:           reads at a time down to " << scanSummary.lowest_read_limit << ", "
+                    << scanSummary.read_limit_changes << " changes\n";
+            }
+            if (options.measure_seek_distance) {
+                std::cerr << "seeks:                 " << scanSummary.seek_count << ", average distance "
+                    << (scanSummary.seek_count > 0 ? scanSummary.seek_distance / scanSummary.seek_count : 0) << " bytes\n";
+            }
+            if (dedupe) {
+                std::cerr << (dedupeOptions.dry_run ? "dedupe (dry run):      " : "dedupe:                ")
+                    << dedupeSummary.files_deduplicated << " files, " << dedupeSummary.files_skipped << " skipped, "
+                    << dedupeSummary.files_failed << " failed, " << dedupeSummary.bytes_reclaimed << " bytes reclaimed\n";
+            }
+        }
+    }
+    catch (const ScanCancelled&) {
+        std::cerr << "dupfinder-cli: scan interrupted";
+        if (!options.checkpoint_file.empty()) {
+            std::cerr << ", continue it with --resume";
+        }
+        std::cerr << '\n';
+        return 128 + SIGINT;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "dupfinder-cli: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
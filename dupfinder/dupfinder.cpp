@@ -9,88 +9,25 @@
 #include <filesystem>
 #include <fstream>
 #include <vector>
-#include <openssl/sha.h> // Requires OpenSSL for SHA-256 hashing
 #include <locale>
 #include <iomanip>
 #include <functional>
 #include <format>
+#include <future>
 #include <thread>
 #include <map>
 #include <string>
 #include <algorithm>
+#include <memory>
+#include <mutex>
 #include <shared_mutex>
 
-namespace fs = std::filesystem;
-
-std::wstring convert_to_wstring(const char* narrow_str) {
-    if (!narrow_str) return L"";
-    return std::wstring(narrow_str, narrow_str + std::strlen(narrow_str));
-}
-
-// Helper function to compute SHA-256 hash of a file
-std::wstring compute_file_hash(const fs::path& file_path, std::function<void(std::wstring)> logCallback = [](std::wstring) {}) {
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + file_path.string());
-    }
-
-    SHA256_CTX ctx;
-    SHA256_Init(&ctx);
+#include "dedupe.h"
+#include "duplicates.h"
+#include "scan_session.h"
+#include "text.h"
 
-    constexpr size_t buffer_size = 8192;
-    char buffer[buffer_size];
-    // size_t total_read = 0;
-    while (file.read(buffer, buffer_size)) {
-        SHA256_Update(&ctx, buffer, file.gcount());
-        // total_read += file.gcount();
-        // std::wcout << L"\rHashing: " << file_path.wstring() << L" (" << total_read << L" bytes processed)" << std::flush;
-    }
-    // Update for any remaining bytes
-    SHA256_Update(&ctx, buffer, file.gcount());
-    // total_read += file.gcount();
-    // std::wcout << L"\rHashing: " << file_path.wstring() << L" (" << total_read << L" bytes processed)" << std::flush;
-
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_Final(hash, &ctx);
-
-    std::wstringstream result;
-    for (unsigned char c : hash) {
-        result << std::setw(2) << std::setfill(L'0') << std::hex << static_cast<int>(c);
-    }
-    // std::wcout << L"\rHashing completed: " << file_path.wstring() << L"                    " << std::endl;
-    logCallback(std::format(L"Hashing completed: {}\r\n", file_path.wstring()));
-    return result.str();
-}
-
-// Function to find duplicate files by hash
-std::unordered_map<std::wstring, std::vector<fs::path>> find_duplicate_files(const fs::path& root, std::function<void(std::wstring)> logCallback = [](std::wstring) {}) {
-    std::unordered_map<std::wstring, std::vector<fs::path>> hash_to_files;
-
-    for (const auto& entry : fs::recursive_directory_iterator(root)) {
-        if (entry.is_regular_file()) {
-            try {
-                auto hash = compute_file_hash(entry.path(), logCallback);
-                hash_to_files[hash].push_back(entry.path());
-            }
-            catch (const std::exception& e) {
-                std::wstring error_message = convert_to_wstring(e.what());
-                logCallback(std::format(L"Error processing file {}: {}\r\n", entry.path().wstring(), error_message));
-            }
-        }
-    }
-
-    // Remove entries with only one file (unique files)
-    for (auto it = hash_to_files.begin(); it != hash_to_files.end();) {
-        if (it->second.size() < 2) {
-            it = hash_to_files.erase(it);
-        }
-        else {
-            ++it;
-        }
-    }
-
-    return hash_to_files;
-}
+namespace fs = std::filesystem;
 
 BOOL InitInstance(HINSTANCE hInstance) {
     return TRUE;
@@ -144,6 +81,20 @@ std::wstring SelectDirectory(HWND hwndOwner) {
     return folderPath;
 }
 
+// Hash cache shared by all scans of the current user, empty if the folder can't be resolved
+std::filesystem::path GetHashCacheFile() {
+    std::filesystem::path cacheFile;
+
+    PWSTR pszLocalAppData = nullptr;
+    HRESULT hr = ::SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, nullptr, &pszLocalAppData);
+    if (SUCCEEDED(hr)) {
+        cacheFile = std::filesystem::path(pszLocalAppData) / L"dupfinder" / L"hashcache.bin";
+    }
+    CoTaskMemFree(pszLocalAppData);
+
+    return cacheFile;
+}
+
 LRESULT CALLBACK ListViewCustomDraw(HWND hwnd, LPARAM lParam) {
     LPNMLVCUSTOMDRAW pCustomDraw = (LPNMLVCUSTOMDRAW)lParam;
 
@@ -1085,6 +1036,11 @@ public:
         uxtheme.CallOnce<HRESULT(__stdcall*)(HWND, PCWSTR, PCWSTR)>("SetWindowTheme", m_hwnd, L"Explorer", nullptr);
     }
 
+    void DeleteAllItems() {
+        ListView_DeleteAllItems(m_hwnd);
+        ListView_RemoveAllGroups(m_hwnd);
+    }
+
     void SetIconSpacing(int horizontal, int vertical) {
         if (!(m_hwnd && ::IsWindow(m_hwnd))) {
             throw std::runtime_error("Invalid window handle");
@@ -1122,6 +1078,14 @@ public:
         InitListView();
     }
 
+    // Remove every group with its items and thumbnails
+    void Clear() {
+        DeleteAllItems();
+        m_imageList.Remove(-1);
+        m_nextGroupId = 0;
+        m_nextItemId = 0;
+    }
+
     int InsertDuplicateGroup(std::wstring hash) {
         int insertedIndex = InsertGroup(m_nextGroupId, hash.c_str(), false, false);
         if (insertedIndex >= 0)
@@ -1305,24 +1269,51 @@ private:
 
         case IDC_BUTTON2:
             if (HIWORD(wParam) == BN_CLICKED) {
+                if (m_scanSession || m_dedupe.valid()) {
+                    return TRUE;
+                }
                 std::wstring selectedFolder = m_editPath.GetText();
-                auto duplicates = find_duplicate_files(selectedFolder, [&](std::wstring message) {
-                    m_editLog.AppendText(message);
+                ScanOptions options;
+                options.hash_cache_file = GetHashCacheFile();
+
+                // The scan runs on threads of its own; the timer polls its progress and picks up
+                // the result, so the window stays responsive
+                m_scanSession = std::make_unique<ScanSession>(std::vector<fs::path>{ selectedFolder }, options, [this](std::wstring message) {
+                    std::lock_guard<std::mutex> lock(m_logMutex);
+                    m_pendingLog += message;
                     });
-
-                for (const auto& [hash, files] : duplicates) {
-                    int groupId = m_listView.InsertDuplicateGroup(hash);
-                    for (const auto& file : files) {
-                        g_fileWatcher.AddFile(file);
-                        m_listView.InsertDuplicateFileItem(file, groupId);
-                    }
-                }
-
+                ::EnableWindow(GetDlgItem(IDC_BUTTON2), FALSE);
+                ::SendMessage(GetDlgItem(IDC_PROGRESS1), PBM_SETRANGE32, 0, progress_range);
+                ::SendMessage(GetDlgItem(IDC_PROGRESS1), PBM_SETPOS, 0, 0);
+                ::SetTimer(m_hwnd, scan_timer_id, scan_timer_interval, nullptr);
                 return TRUE;
                 break;
             }
             break;
 
+        case ID_FILE_DEDUPLICATE:
+            if (!m_scanSession && !m_dedupe.valid() && !m_duplicates.empty() && ::MessageBox(m_hwnd,
+                L"Replace every file of every group but the first with a hard link to the first one?",
+                L"Deduplicate", MB_OKCANCEL | MB_ICONWARNING) == IDOK) {
+                DedupeOptions options;
+                options.method = DedupeMethod::HardLink;
+
+                // The comparisons and links run on a thread of their own like a scan, and the
+                // groups they act on are gone from the list once they start
+                m_dedupe = std::async(std::launch::async, [this, duplicates = std::move(m_duplicates), options] {
+                    return dedupe_duplicate_files(duplicates, options, [this](std::wstring message) {
+                        std::lock_guard<std::mutex> lock(m_logMutex);
+                        m_pendingLog += message;
+                        });
+                    });
+                m_duplicates.clear();
+                m_listView.Clear();
+                ::EnableWindow(GetDlgItem(IDC_BUTTON2), FALSE);
+                ::SetTimer(m_hwnd, scan_timer_id, scan_timer_interval, nullptr);
+            }
+            return TRUE;
+            break;
+
         case ID_VIEW_ICONS:
         case ID_VIEW_LIST:
         case ID_VIEW_DETAILS:
@@ -1337,9 +1328,92 @@ private:
         return FALSE;
     }
 
+    // Poll the running scan or deduplication: hand its log to the edit control, move the progress
+    // bar and show the result once it is done
+    void OnScanTimer() {
+        std::wstring log;
+        {
+            std::lock_guard<std::mutex> lock(m_logMutex);
+            log.swap(m_pendingLog);
+        }
+        if (!log.empty()) {
+            m_editLog.AppendText(log);
+        }
+        if (m_dedupe.valid()) {
+            OnDedupeTimer();
+            return;
+        }
+        if (!m_scanSession) {
+            return;
+        }
+
+        const ScanSnapshot snapshot = m_scanSession->GetSnapshot();
+        if (snapshot.fraction >= 0) {
+            ::SendMessage(GetDlgItem(IDC_PROGRESS1), PBM_SETPOS, static_cast<WPARAM>(snapshot.fraction * progress_range), 0);
+        }
+        if (!m_scanSession->IsFinished()) {
+            return;
+        }
+
+        ::KillTimer(m_hwnd, scan_timer_id);
+        ScanSummary summary;
+        try {
+            auto duplicates = m_scanSession->TakeResult(summary);
+            ShowScanResult(duplicates, summary);
+        }
+        catch (const std::exception& e) {
+            m_editLog.AppendText(L"Scan failed: " + convert_to_wstring(e.what()) + L"\r\n");
+        }
+        m_scanSession.reset();
+        ::EnableWindow(GetDlgItem(IDC_BUTTON2), TRUE);
+        OnScanTimer();
+    }
+
+    void OnDedupeTimer() {
+        if (m_dedupe.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+
+        ::KillTimer(m_hwnd, scan_timer_id);
+        try {
+            m_dedupe.get();
+        }
+        catch (const std::exception& e) {
+            m_editLog.AppendText(L"Deduplication failed: " + convert_to_wstring(e.what()) + L"\r\n");
+        }
+        ::EnableWindow(GetDlgItem(IDC_BUTTON2), TRUE);
+        OnScanTimer();
+    }
+
+    void ShowScanResult(const DuplicateMap& duplicates, const ScanSummary& summary) {
+        m_duplicates = duplicates;
+        for (const auto& [hash, files] : duplicates) {
+            int groupId = m_listView.InsertDuplicateGroup(hash_to_wstring(hash));
+            for (const auto& file : files) {
+                g_fileWatcher.AddFile(file);
+                m_listView.InsertDuplicateFileItem(file, groupId);
+            }
+        }
+
+        // Hard links share one file, so deleting one of them frees nothing
+        for (const auto& links : summary.hard_link_sets) {
+            int groupId = m_listView.InsertDuplicateGroup(L"Hard links");
+            for (const auto& file : links) {
+                m_listView.InsertDuplicateFileItem(file, groupId);
+            }
+        }
+    }
+
     INT_PTR DlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam) override final {
         switch (message) {
 
+        case WM_TIMER:
+            if (wParam == scan_timer_id) {
+                OnScanTimer();
+                return TRUE;
+            }
+            break;
+
         case WM_NOTIFY:
         {
             LPNMHDR pnmh = reinterpret_cast<LPNMHDR>(lParam);
@@ -1386,9 +1460,21 @@ private:
         return DlgProcDefault(hDlg, message, wParam, lParam);
     }
 
-    DuplicateFilesListView m_listView;
+    static constexpr UINT_PTR scan_timer_id = 1;
+    static constexpr UINT scan_timer_interval = 100;
+    static constexpr int progress_range = 1000;
+
     Edit m_editPath;
     Edit m_editLog;
+    DuplicateFilesListView m_listView;
+    // Result of the last scan, which the deduplication acts on
+    DuplicateMap m_duplicates;
+    // Log lines of the running scan or deduplication since the last timer tick
+    std::mutex m_logMutex;
+    std::wstring m_pendingLog;
+    // The workers come last so that they finish before the log they write to goes away
+    std::unique_ptr<ScanSession> m_scanSession;
+    std::future<DedupeSummary> m_dedupe;
 };
 
 std::wstring CharToWChar(const std::string& str) {
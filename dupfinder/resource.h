@@ -20,13 +20,14 @@
 #define ID_FILE_CREATE                  40007
 #define ID_FILE_COPY                    40008
 #define ID_FILE_CUT                     40009
+#define ID_FILE_DEDUPLICATE             40010
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        106
-#define _APS_NEXT_COMMAND_VALUE         40010
+#define _APS_NEXT_COMMAND_VALUE         40011
 #define _APS_NEXT_CONTROL_VALUE         1007
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
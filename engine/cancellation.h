@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+
+// Thrown by a scan, and by the reads of a scan, that stopped because it was cancelled
+class ScanCancelled : public std::runtime_error {
+public:
+    ScanCancelled() : std::runtime_error("Scan cancelled") {}
+};
+
+// Asks a scan running on other threads to stop. The scan checks it between directories and
+// files and its reads check it between buffers, so it stops within a buffer per worker; what was
+// complete by then is kept in the checkpoint, if the scan writes one.
+class CancellationToken {
+public:
+    CancellationToken() = default;
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    void Cancel() noexcept {
+        m_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] bool IsCancelled() const noexcept {
+        return m_cancelled.load(std::memory_order_relaxed);
+    }
+
+    void ThrowIfCancelled() const {
+        if (IsCancelled()) {
+            throw ScanCancelled();
+        }
+    }
+
+private:
+    std::atomic<bool> m_cancelled{ false };
+};
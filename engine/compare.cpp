@@ -0,0 +1,110 @@
+#include "compare.h"
+#include "hasher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+// A file still being compared, with the block it read last
+struct CompareStream {
+    size_t index;
+    FileReader file;
+    std::vector<char> block;
+};
+
+// Members that were identical up to the current offset and the hash of that common prefix
+struct Partition {
+    std::vector<CompareStream*> members;
+    std::unique_ptr<Hasher> hasher;
+};
+
+} // namespace
+
+CompareResult compare_files(const std::vector<fs::path>& paths, uintmax_t size, HashAlgorithm algorithm, const ReadOptions& read_options) {
+    CompareResult result;
+    result.errors.resize(paths.size());
+    result.bytes_read.resize(paths.size());
+
+    std::vector<std::unique_ptr<CompareStream>> streams;
+    Partition initial;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        auto stream = std::make_unique<CompareStream>();
+        stream->index = i;
+        if (!stream->file.Open(paths[i], read_options)) {
+            result.errors[i] = "Failed to open file: " + paths[i].string();
+            continue;
+        }
+        stream->block.resize(static_cast<size_t>(std::min<uintmax_t>(size, compare_block_size)));
+        initial.members.push_back(stream.get());
+        streams.push_back(std::move(stream));
+    }
+    initial.hasher = create_hasher(algorithm);
+
+    std::vector<Partition> partitions;
+    if (initial.members.size() > 1) {
+        partitions.push_back(std::move(initial));
+    }
+
+    for (uintmax_t offset = 0; offset < size && !partitions.empty(); offset += compare_block_size) {
+        const size_t length = static_cast<size_t>(std::min<uintmax_t>(compare_block_size, size - offset));
+
+        std::vector<Partition> next;
+        for (auto& partition : partitions) {
+            std::vector<CompareStream*> readable;
+            for (CompareStream* stream : partition.members) {
+                const size_t count = stream->file.Read(stream->block.data(), length);
+                result.bytes_read[stream->index] += count;
+                if (count != length) {
+                    result.errors[stream->index] = "Failed to read file: " + paths[stream->index].string();
+                    stream->file.Close();
+                    continue;
+                }
+                readable.push_back(stream);
+            }
+
+            // Split the members by the content of this block, keeping their order
+            std::vector<std::vector<CompareStream*>> splits;
+            for (CompareStream* stream : readable) {
+                auto it = std::find_if(splits.begin(), splits.end(), [&](const auto& split) {
+                    return std::memcmp(split.front()->block.data(), stream->block.data(), length) == 0;
+                });
+                if (it != splits.end()) {
+                    it->push_back(stream);
+                }
+                else {
+                    splits.push_back({ stream });
+                }
+            }
+
+            // The hasher of the common prefix is cloned for every split but the last, which takes
+            // it over. Members left alone have no duplicate and are not read any further.
+            size_t remaining = std::count_if(splits.begin(), splits.end(), [](const auto& split) { return split.size() > 1; });
+            for (auto& split : splits) {
+                if (split.size() < 2) {
+                    split.front()->file.Close();
+                    continue;
+                }
+
+                Partition child;
+                child.members = std::move(split);
+                child.hasher = --remaining > 0 ? partition.hasher->Clone() : std::move(partition.hasher);
+                child.hasher->Update(child.members.front()->block.data(), length);
+                next.push_back(std::move(child));
+            }
+        }
+        partitions = std::move(next);
+    }
+
+    for (auto& partition : partitions) {
+        IdenticalFiles group;
+        group.hash = partition.hasher->Final();
+        for (const CompareStream* stream : partition.members) {
+            group.files.push_back(stream->index);
+        }
+        result.groups.push_back(std::move(group));
+    }
+
+    return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "digest.h"
+#include "file_reader.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Files found identical by compare_files, keyed by the digest of their common content
+struct IdenticalFiles {
+    Digest hash;
+    // Indices into the compared paths, in their original order
+    std::vector<size_t> files;
+};
+
+// Outcome of compare_files
+struct CompareResult {
+    std::vector<IdenticalFiles> groups;
+    // Per path: the error if it could not be read, empty otherwise, and the bytes read from it
+    std::vector<std::string> errors;
+    std::vector<uintmax_t> bytes_read;
+};
+
+// Bytes every file of a group contributes to one lockstep comparison step
+constexpr size_t compare_block_size = 128 * 1024;
+
+// Compare same-size files block by block in lockstep and return the sets of two or more identical
+// files. A set is split as soon as the blocks of its members differ, and reading stops once no
+// set has two members left. Instead of every file only one member of every set is hashed, which
+// gives each result the digest compute_file_hash would produce for all of them.
+CompareResult compare_files(const std::vector<fs::path>& paths, uintmax_t size, HashAlgorithm algorithm, const ReadOptions& read_options = {});
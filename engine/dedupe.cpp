@@ -0,0 +1,369 @@
+#include "dedupe.h"
+#include "compare.h"
+#include "file_identity.h"
+#include "shared_extents.h"
+#include "text.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// What happened to one redundant copy
+struct DedupeAction {
+    enum class Status {
+        Deduplicated,
+        Skipped,
+        Failed,
+    };
+
+    Status status = Status::Failed;
+    uintmax_t bytes_reclaimed = 0;
+    std::string message;
+};
+
+// A group with the kept file first and the slot of every copy after it
+struct DedupeGroup {
+    const std::vector<fs::path>* files;
+    std::vector<DedupeAction> actions;
+};
+
+DedupeAction skipped(std::string message) {
+    return { DedupeAction::Status::Skipped, 0, std::move(message) };
+}
+
+DedupeAction failed(std::string message) {
+    return { DedupeAction::Status::Failed, 0, std::move(message) };
+}
+
+#ifdef __linux__
+
+// Bytes per FIDEDUPERANGE call; btrfs refuses longer ranges
+constexpr uint64_t dedupe_range_length = 16 * 1024 * 1024;
+
+// Destinations per FIDEDUPERANGE call, which keeps the argument within a page
+constexpr size_t dedupe_range_targets = 64;
+
+struct FileCloser {
+    int fd = -1;
+
+    ~FileCloser() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+std::string errno_message(const char* what, int error) {
+    return std::string(what) + ": " + std::strerror(error);
+}
+
+void dedupe_group_reflink(DedupeGroup& group, bool dry_run) {
+    const auto& files = *group.files;
+    FileCloser source{ ::open(files[0].c_str(), O_RDONLY | O_CLOEXEC) };
+    struct stat sourceStat;
+    if (source.fd < 0 || ::fstat(source.fd, &sourceStat) != 0) {
+        for (auto& action : group.actions) {
+            action = failed(errno_message("Failed to open the kept file", errno));
+        }
+        return;
+    }
+
+    // FIDEDUPERANGE counts ranges that were already shared as deduplicated again, so copies that
+    // read the very extents of the kept file, as after an earlier run, are left out
+    std::vector<FileExtent> sourceExtents;
+    const bool sourceShared = get_shared_extents(files[0], sourceExtents);
+
+    // Copies that are still being deduplicated, with their descriptors
+    std::vector<FileCloser> targets(group.actions.size());
+    std::vector<size_t> active;
+    for (size_t i = 0; i < group.actions.size(); ++i) {
+        auto& target = targets[i];
+        target.fd = ::open(files[i + 1].c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat targetStat;
+        if (target.fd < 0 || ::fstat(target.fd, &targetStat) != 0) {
+            group.actions[i] = failed(errno_message("Failed to open file", errno));
+            continue;
+        }
+        if (targetStat.st_dev == sourceStat.st_dev && targetStat.st_ino == sourceStat.st_ino) {
+            group.actions[i] = skipped("already the same file");
+            continue;
+        }
+        if (targetStat.st_size != sourceStat.st_size) {
+            group.actions[i] = skipped("size changed since the scan");
+            continue;
+        }
+        std::vector<FileExtent> targetExtents;
+        if (sourceShared && targetStat.st_dev == sourceStat.st_dev && get_shared_extents(files[i + 1], targetExtents)
+            && targetExtents == sourceExtents) {
+            group.actions[i] = skipped("already shares the storage of the kept file");
+            continue;
+        }
+        group.actions[i] = { DedupeAction::Status::Deduplicated, dry_run ? static_cast<uintmax_t>(sourceStat.st_size) : 0, {} };
+        active.push_back(i);
+    }
+    if (dry_run) {
+        return;
+    }
+
+    const uint64_t size = static_cast<uint64_t>(sourceStat.st_size);
+    const size_t argumentSize = sizeof(file_dedupe_range) + dedupe_range_targets * sizeof(file_dedupe_range_info);
+    auto buffer = std::make_unique<uint64_t[]>((argumentSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    auto* range = reinterpret_cast<file_dedupe_range*>(buffer.get());
+
+    for (uint64_t offset = 0; offset < size && !active.empty(); offset += dedupe_range_length) {
+        const uint64_t length = std::min(dedupe_range_length, size - offset);
+
+        std::vector<size_t> next;
+        for (size_t first = 0; first < active.size(); first += dedupe_range_targets) {
+            const size_t count = std::min(dedupe_range_targets, active.size() - first);
+            std::memset(buffer.get(), 0, argumentSize);
+            range->src_offset = offset;
+            range->src_length = length;
+            range->dest_count = static_cast<uint16_t>(count);
+            for (size_t j = 0; j < count; ++j) {
+                range->info[j].dest_fd = targets[active[first + j]].fd;
+                range->info[j].dest_offset = offset;
+            }
+
+            if (::ioctl(source.fd, FIDEDUPERANGE, range) != 0) {
+                const int error = errno;
+                for (size_t j = 0; j < count; ++j) {
+                    group.actions[active[first + j]] = failed(errno_message("FIDEDUPERANGE failed", error));
+                }
+                continue;
+            }
+
+            for (size_t j = 0; j < count; ++j) {
+                auto& action = group.actions[active[first + j]];
+                const auto& info = range->info[j];
+                if (info.status < 0) {
+                    action = failed(errno_message("FIDEDUPERANGE failed", -info.status));
+                    continue;
+                }
+                action.bytes_reclaimed += info.bytes_deduped;
+                if (info.status == FILE_DEDUPE_RANGE_DIFFERS) {
+                    action.status = DedupeAction::Status::Skipped;
+                    action.message = "content changed since the scan at offset " + std::to_string(offset);
+                    continue;
+                }
+                next.push_back(active[first + j]);
+            }
+        }
+        active = std::move(next);
+    }
+}
+
+#else
+
+void dedupe_group_reflink(DedupeGroup& group, bool) {
+    for (auto& action : group.actions) {
+        action = failed("Reflinks are not supported on this platform");
+    }
+}
+
+#endif
+
+// Attempts at a free name for the temporary link before giving up
+constexpr int temp_link_attempts = 16;
+
+// Create a hard link to source under a name next to target that nothing else uses, and return
+// that name. Names that exist are never touched; another random suffix is tried instead.
+fs::path create_temp_link(const fs::path& source, const fs::path& target, std::error_code& ec) {
+    thread_local std::mt19937_64 random(std::random_device{}());
+    for (int attempt = 0; attempt < temp_link_attempts; ++attempt) {
+        char suffix[17];
+        std::snprintf(suffix, sizeof(suffix), "%016llx", static_cast<unsigned long long>(random()));
+        fs::path temp = target;
+        temp.replace_filename(fs::path(".").concat(target.filename().native()).concat(".dupfinder-link-").concat(suffix));
+        fs::create_hard_link(source, temp, ec);
+        if (ec != std::errc::file_exists) {
+            return temp;
+        }
+    }
+    return {};
+}
+
+void dedupe_group_hard_link(DedupeGroup& group, bool dry_run) {
+    const auto& files = *group.files;
+    FileIdentity source;
+    if (!get_file_identity(files[0], source)) {
+        for (auto& action : group.actions) {
+            action = failed("Failed to query the kept file");
+        }
+        return;
+    }
+
+    // Paths still to be linked; the kept file is compared along with them
+    std::vector<fs::path> paths{ files[0] };
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < group.actions.size(); ++i) {
+        FileIdentity target;
+        if (!get_file_identity(files[i + 1], target)) {
+            group.actions[i] = failed("Failed to query file");
+            continue;
+        }
+        if (target.device == source.device && target.inode == source.inode) {
+            group.actions[i] = skipped("already the same file");
+            continue;
+        }
+        if (target.device != source.device) {
+            group.actions[i] = failed("on another file system than the kept file");
+            continue;
+        }
+        if (target.size != source.size) {
+            group.actions[i] = skipped("size changed since the scan");
+            continue;
+        }
+        paths.push_back(files[i + 1]);
+        pending.push_back(i);
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    // The content is checked again right before the copies are replaced, unless nothing changes
+    std::vector<bool> identical(paths.size(), dry_run);
+    std::vector<std::string> errors(paths.size());
+    if (!dry_run) {
+        auto comparison = compare_files(paths, source.size, HashAlgorithm::Sha256);
+        for (const auto& set : comparison.groups) {
+            if (set.files.front() == 0) {
+                for (size_t index : set.files) {
+                    identical[index] = true;
+                }
+            }
+        }
+        errors = std::move(comparison.errors);
+        if (!errors[0].empty()) {
+            for (size_t i : pending) {
+                group.actions[i] = failed(errors[0]);
+            }
+            return;
+        }
+    }
+
+    for (size_t j = 0; j < pending.size(); ++j) {
+        const size_t i = pending[j];
+        if (!errors[j + 1].empty()) {
+            group.actions[i] = failed(errors[j + 1]);
+            continue;
+        }
+        if (!identical[j + 1]) {
+            group.actions[i] = skipped("content differs from the kept file");
+            continue;
+        }
+
+        const fs::path& target = paths[j + 1];
+        std::error_code ec;
+        const uintmax_t links = fs::hard_link_count(target, ec);
+        const uintmax_t reclaimed = !ec && links == 1 ? source.size : 0;
+        if (dry_run) {
+            group.actions[i] = { DedupeAction::Status::Deduplicated, reclaimed, {} };
+            continue;
+        }
+
+        // Link next to the copy and rename the link over it, which replaces the path atomically
+        const fs::path temp = create_temp_link(files[0], target, ec);
+        if (!ec) {
+            fs::rename(temp, target, ec);
+            if (ec) {
+                std::error_code removeEc;
+                fs::remove(temp, removeEc);
+            }
+        }
+        if (ec) {
+            group.actions[i] = failed(ec.message());
+            continue;
+        }
+        group.actions[i] = { DedupeAction::Status::Deduplicated, reclaimed, {} };
+    }
+}
+
+} // namespace
+
+DedupeSummary dedupe_duplicate_files(const DuplicateMap& duplicates, const DedupeOptions& options, LogCallback logCallback) {
+    DedupeSummary summary;
+
+    std::vector<DedupeGroup> groups;
+    for (const auto& [hash, files] : duplicates) {
+        if (files.size() > 1) {
+            groups.push_back({ &files, std::vector<DedupeAction>(files.size() - 1) });
+        }
+    }
+    summary.groups = groups.size();
+
+    // Every group writes only its own actions; the results are logged here once all are done
+    ThreadPool pool(options.thread_count);
+    const size_t batch = std::max<size_t>(options.batch_groups, 1);
+    for (size_t first = 0; first < groups.size(); first += batch) {
+        pool.Submit([&groups, &options, first, last = std::min(first + batch, groups.size())] {
+            for (size_t i = first; i < last; ++i) {
+                try {
+                    if (options.method == DedupeMethod::Reflink) {
+                        dedupe_group_reflink(groups[i], options.dry_run);
+                    }
+                    else {
+                        dedupe_group_hard_link(groups[i], options.dry_run);
+                    }
+                }
+                catch (const std::exception& e) {
+                    for (auto& action : groups[i].actions) {
+                        if (action.status == DedupeAction::Status::Failed && action.message.empty()) {
+                            action.message = e.what();
+                        }
+                    }
+                }
+            }
+        });
+    }
+    pool.Wait();
+
+    const std::wstring verb = options.dry_run ? L"Would deduplicate " : L"Deduplicated ";
+    for (const auto& group : groups) {
+        const auto& files = *group.files;
+        for (size_t i = 0; i < group.actions.size(); ++i) {
+            const auto& action = group.actions[i];
+            const std::wstring target = path_to_wstring(files[i + 1]);
+            switch (action.status) {
+            case DedupeAction::Status::Deduplicated:
+                ++summary.files_deduplicated;
+                summary.bytes_reclaimed += action.bytes_reclaimed;
+                logCallback(verb + target + L" with " + path_to_wstring(files[0]) + L"\r\n");
+                break;
+            case DedupeAction::Status::Skipped:
+                ++summary.files_skipped;
+                summary.bytes_reclaimed += action.bytes_reclaimed;
+                logCallback(L"Skipped " + target + L": " + convert_to_wstring(action.message.c_str()) + L"\r\n");
+                break;
+            case DedupeAction::Status::Failed:
+                ++summary.files_failed;
+                logCallback(L"Failed to deduplicate " + target + L": " + convert_to_wstring(action.message.c_str()) + L"\r\n");
+                break;
+            }
+        }
+    }
+
+    logCallback(std::wstring(options.dry_run ? L"Dry run: " : L"") + std::to_wstring(summary.files_deduplicated) + L" files deduplicated, "
+        + std::to_wstring(summary.files_skipped) + L" skipped, " + std::to_wstring(summary.files_failed) + L" failed in "
+        + std::to_wstring(summary.groups) + L" groups, " + std::to_wstring(summary.bytes_reclaimed) + L" bytes reclaimed\r\n");
+
+    return summary;
+}
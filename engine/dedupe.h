@@ -0,0 +1,47 @@
+#pragma once
+
+#include "duplicates.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// How a redundant copy is made to share the storage of the file kept from its group
+enum class DedupeMethod {
+    // FIDEDUPERANGE on btrfs and XFS: the kernel compares both files and only then shares their
+    // extents, so a file changed since the scan is left alone. The files stay independent.
+    Reflink,
+    // Replace the copy with a hard link to the kept file, through a temporary link renamed over
+    // it so the path never goes missing. The content is compared again right before.
+    HardLink,
+};
+
+// Tunables of the deduplication engine
+struct DedupeOptions {
+    DedupeMethod method = DedupeMethod::Reflink;
+    // Check and report every action without changing anything
+    bool dry_run = false;
+    // Worker threads, 0 means one per hardware thread
+    unsigned thread_count = 0;
+    // Groups handed to a worker at a time
+    size_t batch_groups = 64;
+};
+
+// Outcome of a deduplication run
+struct DedupeSummary {
+    uintmax_t groups = 0;
+    // Redundant copies that now share the kept file's storage, or would in a dry run
+    uintmax_t files_deduplicated = 0;
+    // Copies left alone because they already share it or changed since the scan
+    uintmax_t files_skipped = 0;
+    uintmax_t files_failed = 0;
+    // Storage freed, or that would be freed in a dry run. A hard-linked copy frees its size only
+    // if the path was its last link; a reflinked copy frees what the kernel reports as shared,
+    // and a copy whose extents are already all those of the kept file is skipped, not counted.
+    uintmax_t bytes_reclaimed = 0;
+};
+
+// Make every file of every group after the first share the storage of the first one. Groups are
+// processed in parallel batches and every action is logged. Reflinks are only available on
+// Linux; elsewhere every file of a Reflink run fails.
+DedupeSummary dedupe_duplicate_files(const DuplicateMap& duplicates, const DedupeOptions& options,
+    LogCallback logCallback = [](std::wstring) {});
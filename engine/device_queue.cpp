@@ -0,0 +1,152 @@
+#include "device_queue.h"
+
+#ifdef __linux__
+#include <fstream>
+
+#include <sys/sysmacros.h>
+#endif
+
+bool is_rotational_device(uint64_t device) {
+#ifdef __linux__
+    const std::string block = "/sys/dev/block/" + device_to_string(device);
+    for (const char* queue : { "/queue/rotational", "/../queue/rotational" }) {
+        int rotational = 0;
+        if (std::ifstream(block + queue) >> rotational) {
+            return rotational != 0;
+        }
+    }
+#else
+    (void)device;
+#endif
+    return false;
+}
+
+std::string device_to_string(uint64_t device) {
+#ifdef __linux__
+    return std::to_string(major(device)) + ":" + std::to_string(minor(device));
+#else
+    return std::to_string(device);
+#endif
+}
+
+DeviceQueues::DeviceQueues(ThreadPool& pool, unsigned concurrency, unsigned rotationalConcurrency)
+    : m_pool(pool), m_concurrency(concurrency), m_rotationalConcurrency(rotationalConcurrency ? rotationalConcurrency : concurrency) {
+}
+
+void DeviceQueues::Submit(uint64_t device, std::function<uintmax_t()> task) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Device& queue = GetDevice(device);
+
+    // A pool without workers runs everything inline, one read at a time anyway
+    if (m_pool.GetThreadCount() == 1) {
+        ++queue.running;
+        ++m_running;
+        queue.busy_since = std::chrono::steady_clock::now();
+        lock.unlock();
+        const uintmax_t bytes = task();
+        lock.lock();
+        Finish(queue, bytes);
+        return;
+    }
+
+    queue.pending.push_back(std::move(task));
+    Dispatch(queue);
+}
+
+bool DeviceQueues::IsLimited(uint64_t device) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const unsigned limit = GetDevice(device).stats.concurrency;
+    return limit > 0 && limit < m_pool.GetThreadCount();
+}
+
+void DeviceQueues::SetTotalLimit(unsigned limit) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_totalLimit = limit;
+    DispatchAll();
+}
+
+std::vector<DeviceStats> DeviceQueues::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<DeviceStats> stats;
+    for (const auto& [id, device] : m_devices) {
+        if (device.stats.files > 0) {
+            stats.push_back(device.stats);
+        }
+    }
+    return stats;
+}
+
+DeviceQueues::Device& DeviceQueues::GetDevice(uint64_t device) {
+    auto [it, inserted] = m_devices.try_emplace(device);
+    if (inserted) {
+        it->second.stats.device = device;
+        it->second.stats.rotational = is_rotational_device(device);
+        it->second.stats.concurrency = it->second.stats.rotational ? m_rotationalConcurrency : m_concurrency;
+    }
+    return it->second;
+}
+
+// Whether a device may have one more read running; called with the mutex held
+bool DeviceQueues::CanDispatch(const Device& device) const {
+    return !device.pending.empty() && (device.stats.concurrency == 0 || device.running < device.stats.concurrency)
+        && (m_totalLimit == 0 || m_running < m_totalLimit);
+}
+
+// Hand queued reads of a device to the pool up to its limit; called with the mutex held
+void DeviceQueues::Dispatch(Device& device) {
+    while (CanDispatch(device)) {
+        DispatchOne(device);
+    }
+}
+
+// Hand queued reads to the pool one device at a time in turn, so that under a total limit every
+// device gets its share; called with the mutex held
+void DeviceQueues::DispatchAll() {
+    for (bool dispatched = true; dispatched;) {
+        dispatched = false;
+        for (auto& [id, device] : m_devices) {
+            if (CanDispatch(device)) {
+                DispatchOne(device);
+                dispatched = true;
+            }
+        }
+    }
+}
+
+void DeviceQueues::DispatchOne(Device& device) {
+    ++m_running;
+    if (device.running++ == 0) {
+        device.busy_since = std::chrono::steady_clock::now();
+    }
+    m_pool.Submit([this, &device, task = std::move(device.pending.front())] {
+        uintmax_t bytes = 0;
+        try {
+            bytes = task();
+        }
+        catch (...) {
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Finish(device, bytes);
+        if (m_totalLimit == 0) {
+            Dispatch(device);
+        }
+        else {
+            DispatchAll();
+        }
+    });
+    device.pending.pop_front();
+}
+
+// Account a finished read; called with the mutex held. Map nodes are stable, so the pool tasks
+// can keep referring to their device while others are added.
+void DeviceQueues::Finish(Device& device, uintmax_t bytes) {
+    if (device.running == 0) {
+        return;
+    }
+    --m_running;
+    ++device.stats.files;
+    device.stats.bytes_read += bytes;
+    if (--device.running == 0) {
+        device.stats.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - device.busy_since).count();
+    }
+}
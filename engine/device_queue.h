@@ -0,0 +1,84 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Reads of one device during a scan
+struct DeviceStats {
+    uint64_t device = 0;
+    bool rotational = false;
+    // Reads admitted to the workers at a time, 0 for no limit
+    unsigned concurrency = 0;
+    uintmax_t files = 0;
+    uintmax_t bytes_read = 0;
+    // Time with at least one read of the device running; bytes_read over it is the throughput
+    double busy_seconds = 0;
+};
+
+// Whether a device is a spinning disk, from the rotational flag Linux keeps for every block
+// device; a partition reports the flag of its disk. False when it can't tell, which includes
+// devices without a block device behind them and every platform other than Linux.
+bool is_rotational_device(uint64_t device);
+
+// Readable name of a device ID: major:minor on Linux, the number elsewhere
+std::string device_to_string(uint64_t device);
+
+// One FIFO queue of reads per device, all feeding a shared pool. A device only has up to its
+// concurrency limit of reads handed to the pool at a time and the rest wait in its own queue,
+// so a slow disk neither fills the pool's queue ahead of the other devices nor gets more
+// parallel reads than it can take. Every task returns the bytes it read.
+class DeviceQueues {
+public:
+    DeviceQueues(const DeviceQueues&) = delete;
+    DeviceQueues& operator=(const DeviceQueues&) = delete;
+
+    // A limit of 0 means no limit beyond the pool's workers; a rotational limit of 0 means the
+    // general one
+    DeviceQueues(ThreadPool& pool, unsigned concurrency, unsigned rotationalConcurrency);
+
+    void Submit(uint64_t device, std::function<uintmax_t()> task);
+
+    // Whether the reads of a device are limited below the pool's workers
+    bool IsLimited(uint64_t device);
+
+    // Limit on the reads of all devices together, on top of the per-device limits; 0 means none.
+    // Every read of a scan goes through the queues, batches of small files included, so the
+    // I/O pressure controller that sets it throttles them all. Can be changed while reads run: a
+    // raised limit hands queued reads to the pool at once, a lowered one lets the reads above it
+    // finish.
+    void SetTotalLimit(unsigned limit);
+
+    // Statistics of every device that had a read, by device ID. Call after the pool is idle.
+    std::vector<DeviceStats> GetStats() const;
+
+private:
+    struct Device {
+        DeviceStats stats;
+        std::deque<std::function<uintmax_t()>> pending;
+        unsigned running = 0;
+        std::chrono::steady_clock::time_point busy_since;
+    };
+
+    Device& GetDevice(uint64_t device);
+    bool CanDispatch(const Device& device) const;
+    void Dispatch(Device& device);
+    void DispatchAll();
+    void DispatchOne(Device& device);
+    void Finish(Device& device, uintmax_t bytes);
+
+    ThreadPool& m_pool;
+    unsigned m_concurrency;
+    unsigned m_rotationalConcurrency;
+    unsigned m_totalLimit = 0;
+    unsigned m_running = 0;
+    std::map<uint64_t, Device> m_devices;
+    mutable std::mutex m_mutex;
+};
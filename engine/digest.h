@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Content hash algorithms the engine can be built with
+enum class HashAlgorithm : uint8_t {
+    Sha256,
+    Sha1,
+    Blake3,
+    Xxh3_128,
+};
+
+// Fixed-size binary content digest. The engine keys its maps on this instead of the hex string,
+// which is only produced when a group is displayed or exported. Digests shorter than max_size
+// are zero-padded; the algorithm is part of the value so results of different hashers never mix.
+struct Digest {
+    static constexpr size_t max_size = 32;
+
+    std::array<unsigned char, max_size> bytes{};
+    uint8_t size = max_size;
+    HashAlgorithm algorithm = HashAlgorithm::Sha256;
+
+    bool operator==(const Digest& other) const = default;
+};
+
+// Digests are already uniformly distributed, so the first 8 bytes make a good hash
+struct DigestHash {
+    size_t operator()(const Digest& digest) const noexcept {
+        uint64_t value;
+        std::memcpy(&value, digest.bytes.data(), sizeof(value));
+        return static_cast<size_t>(value);
+    }
+};
@@ -0,0 +1,1272 @@
+#include "duplicates.h"
+#include "cancellation.h"
+#include "compare.h"
+#include "device_queue.h"
+#include "hash_cache.h"
+#include "io_pressure.h"
+#include "log_pipeline.h"
+#include "physical_offset.h"
+#include "scan_checkpoint.h"
+#include "scan_session.h"
+#include "shared_extents.h"
+#include "sparse_file.h"
+#include "text.h"
+#include "thread_pool.h"
+#include "traversal.h"
+#include "uring_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+
+// Digests of the passes a candidate completed, as the checkpoint records them, and the identity
+// of the file when it was read
+struct PassDigests {
+    FileIdentity identity;
+    Digest head_tail;
+    Digest middle;
+    Digest full;
+};
+
+// A regular file found by the traversal together with the result of the pass it is currently in.
+// Every pass writes the result fields of a candidate from exactly one task, so workers never
+// share anything but the read-only options.
+struct Candidate {
+    fs::path path;
+    uintmax_t size = 0;
+    Digest hash;
+    std::wstring error;
+    uintmax_t bytes_read = 0;
+    // Taken from the traversal, or the first time the candidate is looked up in the hash cache
+    FileIdentity identity;
+    bool has_identity = false;
+    // 0 when the traversal couldn't tell
+    uint64_t link_count = 0;
+    // Further hard links to the same file, which are never read on their own
+    std::vector<fs::path> links;
+    // Set by the head/tail pass when the file shares all extents with an earlier candidate, which
+    // then stands for both; filled in on the earlier candidate once the pass is done
+    Candidate* shares_extents_with = nullptr;
+    std::vector<fs::path> extent_sharers;
+    // Set by the final pass when the file was confirmed by comparison; a compared file that
+    // matched no other has no hash and is dropped
+    bool compared = false;
+    bool unique = false;
+    // Where the data starts on the device, looked up on the calling thread when reads are ordered
+    // or measured
+    uint64_t physical_offset = 0;
+    bool has_physical_offset = false;
+    bool located = false;
+    // With checkpoints: the passes the candidate completed, as CheckpointFile pass bits, and their
+    // digests. The worker that completes a pass stores the digest before it sets the pass, so the
+    // checkpoint can be written on the calling thread while other candidates are being read.
+    // Passes restored from a checkpoint are set before any worker sees the candidate.
+    bool keep_digests = false;
+    std::unique_ptr<PassDigests> digests;
+    std::atomic<uint8_t> passes{ 0 };
+};
+
+uint8_t pass_bit(CachedHashKey::Kind pass) {
+    switch (pass) {
+    case CachedHashKey::Kind::HeadTail:
+        return CheckpointFile::HeadTailPass;
+    case CachedHashKey::Kind::Middle:
+        return CheckpointFile::MiddlePass;
+    case CachedHashKey::Kind::Full:
+        return CheckpointFile::FullPass;
+    }
+    return 0;
+}
+
+// Record that a candidate completed a pass with digest, for the checkpoint. A unique candidate
+// finished the final pass by comparison without a match and has no full digest. Called by the
+// worker that read the candidate; nothing happens without checkpoints.
+void complete_pass(Candidate& candidate, CachedHashKey::Kind pass, const Digest& digest, bool unique = false) {
+    if (!candidate.keep_digests) {
+        return;
+    }
+    if (!candidate.digests) {
+        // The first pass a file completes in a scan is the head/tail pass, which is when the
+        // identity its digests belong to is taken
+        candidate.digests = std::make_unique<PassDigests>();
+        if (!candidate.has_identity) {
+            candidate.has_identity = get_file_identity(candidate.path, candidate.identity);
+        }
+        candidate.digests->identity = candidate.identity;
+    }
+    switch (pass) {
+    case CachedHashKey::Kind::HeadTail:
+        candidate.digests->head_tail = digest;
+        break;
+    case CachedHashKey::Kind::Middle:
+        candidate.digests->middle = digest;
+        break;
+    case CachedHashKey::Kind::Full:
+        candidate.digests->full = digest;
+        break;
+    }
+    candidate.passes.fetch_or(unique ? static_cast<uint8_t>(CheckpointFile::UniquePass) : pass_bit(pass), std::memory_order_release);
+}
+
+// Whether a candidate completed a pass before the scan was resumed, which is then not read again
+bool has_restored_pass(const Candidate& candidate, CachedHashKey::Kind pass) {
+    return (candidate.passes.load(std::memory_order_relaxed) & pass_bit(pass)) != 0;
+}
+
+// Give a candidate the digest of a pass it completed before the scan was resumed. Returns false,
+// leaving the candidate alone, when it has to be read for the pass.
+bool restore_pass(Candidate& candidate, CachedHashKey::Kind pass) {
+    if (!has_restored_pass(candidate, pass)) {
+        return false;
+    }
+    candidate.bytes_read = 0;
+    switch (pass) {
+    case CachedHashKey::Kind::HeadTail:
+        candidate.hash = candidate.digests->head_tail;
+        break;
+    case CachedHashKey::Kind::Middle:
+        candidate.hash = candidate.digests->middle;
+        break;
+    case CachedHashKey::Kind::Full:
+        candidate.hash = candidate.digests->full;
+        break;
+    }
+    return true;
+}
+
+// Give the files of a group the results of a comparison completed before the scan was resumed.
+// A unique file only stays unique among the same files, so the whole group is compared again as
+// soon as one of them has to be read.
+bool restore_comparison(const std::vector<Candidate*>& files) {
+    for (const Candidate* candidate : files) {
+        if (!(candidate->passes.load(std::memory_order_relaxed) & (CheckpointFile::FullPass | CheckpointFile::UniquePass))) {
+            return false;
+        }
+    }
+    for (Candidate* candidate : files) {
+        candidate->compared = true;
+        candidate->bytes_read = 0;
+        if (candidate->passes.load(std::memory_order_relaxed) & CheckpointFile::UniquePass) {
+            candidate->unique = true;
+        }
+        else {
+            candidate->hash = candidate->digests->full;
+        }
+    }
+    return true;
+}
+
+// A file as its device and file ID, which all hard links to it share
+struct InodeKey {
+    uint64_t device;
+    uint64_t inode;
+
+    bool operator==(const InodeKey& other) const = default;
+};
+
+struct InodeKeyHash {
+    size_t operator()(const InodeKey& key) const noexcept {
+        return std::hash<uint64_t>()(key.inode) ^ (std::hash<uint64_t>()(key.device) << 1);
+    }
+};
+
+// A file's size and device with its extent map; candidates with equal keys have the same content
+struct ExtentKey {
+    uintmax_t size;
+    uint64_t device;
+    std::vector<FileExtent> extents;
+
+    bool operator==(const ExtentKey& other) const = default;
+};
+
+struct ExtentKeyHash {
+    size_t operator()(const ExtentKey& key) const noexcept {
+        size_t hash = std::hash<uintmax_t>()(key.size) ^ (std::hash<uint64_t>()(key.device) << 1);
+        for (const auto& extent : key.extents) {
+            hash = hash * 31 + std::hash<uint64_t>()(extent.physical ^ (extent.logical << 7) ^ (extent.length << 13));
+        }
+        return hash;
+    }
+};
+
+// Candidates registered by their shared extents during the head/tail pass
+struct ExtentRegistry {
+    std::mutex mutex;
+    std::unordered_map<ExtentKey, Candidate*, ExtentKeyHash> candidates;
+
+    // Register a candidate whose data is all shared and return the earlier one with the same
+    // extents, or null when it is the first or not shared at all
+    Candidate* Register(Candidate& candidate) {
+        ExtentKey key{ candidate.size, 0, {} };
+        if (!get_shared_extents(candidate.path, key.extents)) {
+            return nullptr;
+        }
+        if (!candidate.has_identity) {
+            candidate.has_identity = get_file_identity(candidate.path, candidate.identity);
+            if (!candidate.has_identity) {
+                return nullptr;
+            }
+        }
+        key.device = candidate.identity.device;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [it, inserted] = candidates.try_emplace(std::move(key), &candidate);
+        return inserted ? nullptr : it->second;
+    }
+};
+
+// Persistent hash cache of a scan together with its counters, shared by all workers
+struct ScanCache {
+    HashCache cache;
+    std::atomic<uintmax_t> hits{ 0 };
+    std::atomic<uintmax_t> misses{ 0 };
+};
+
+// Digest an earlier scan stored for the candidate under key, if the file hasn't changed since
+std::optional<Digest> lookup_cached_hash(ScanCache* cache, Candidate& candidate, const CachedHashKey& key) {
+    if (!cache) {
+        return std::nullopt;
+    }
+    if (!candidate.has_identity) {
+        candidate.has_identity = get_file_identity(candidate.path, candidate.identity);
+    }
+
+    auto digest = candidate.has_identity ? cache->cache.Lookup(candidate.identity, key) : std::nullopt;
+    ++(digest ? cache->hits : cache->misses);
+    return digest;
+}
+
+void store_cached_hash(ScanCache* cache, const Candidate& candidate, const CachedHashKey& key, const Digest& digest) {
+    if (cache && candidate.has_identity) {
+        cache->cache.Store(candidate.identity, key, digest);
+    }
+}
+
+// Return the cached digest of an unchanged file, or compute it with hashFn and store it for the
+// next scan. Without a cache this is just hashFn.
+template<typename HashFn>
+Digest cached_hash(ScanCache* cache, Candidate& candidate, const CachedHashKey& key, HashFn hashFn) {
+    if (auto digest = lookup_cached_hash(cache, candidate, key)) {
+        return *digest;
+    }
+    Digest digest = hashFn();
+    store_cached_hash(cache, candidate, key, digest);
+    return digest;
+}
+
+// Candidates of the same size that may still turn out to be duplicates of each other
+struct CandidateGroup {
+    uintmax_t size;
+    // Hash the group was split by last
+    Digest hash;
+    std::vector<Candidate*> files;
+};
+
+void locate_candidate(Candidate& candidate) {
+    if (!candidate.located) {
+        candidate.has_physical_offset = get_physical_offset(candidate.path, candidate.physical_offset);
+        candidate.located = true;
+    }
+}
+
+// Sort candidates by where their data starts so that a rotational disk is swept in one direction.
+// Files without a known location keep their order behind the others.
+void sort_by_physical_offset(std::vector<Candidate*>& files) {
+    for (Candidate* candidate : files) {
+        locate_candidate(*candidate);
+    }
+    std::stable_sort(files.begin(), files.end(), [](const Candidate* a, const Candidate* b) {
+        if (a->has_physical_offset != b->has_physical_offset) {
+            return a->has_physical_offset;
+        }
+        return a->physical_offset < b->physical_offset;
+    });
+}
+
+// Distance the disk head travels between the first blocks of files read one after the other
+struct SeekMeter {
+    uintmax_t distance = 0;
+    uintmax_t seeks = 0;
+
+    void Record(const std::vector<Candidate*>& order) {
+        const Candidate* previous = nullptr;
+        for (Candidate* candidate : order) {
+            locate_candidate(*candidate);
+            if (!candidate->has_physical_offset) {
+                continue;
+            }
+            if (previous) {
+                distance += candidate->physical_offset > previous->physical_offset
+                    ? candidate->physical_offset - previous->physical_offset
+                    : previous->physical_offset - candidate->physical_offset;
+                ++seeks;
+            }
+            previous = candidate;
+        }
+    }
+};
+
+// A candidate together with the group it is read for
+struct ReadTask {
+    const CandidateGroup* group;
+    Candidate* candidate;
+};
+
+// Every candidate of every group in the order they are read: group by group, or by their
+// physical offset
+std::vector<ReadTask> schedule_reads(const std::vector<CandidateGroup>& groups, bool by_physical_offset) {
+    std::vector<Candidate*> files;
+    std::unordered_map<const Candidate*, const CandidateGroup*> file_to_group;
+    for (const auto& group : groups) {
+        for (Candidate* candidate : group.files) {
+            files.push_back(candidate);
+            if (by_physical_offset) {
+                file_to_group[candidate] = &group;
+            }
+        }
+    }
+
+    std::vector<ReadTask> tasks;
+    tasks.reserve(files.size());
+    if (by_physical_offset) {
+        sort_by_physical_offset(files);
+        for (Candidate* candidate : files) {
+            tasks.push_back({ file_to_group[candidate], candidate });
+        }
+        return tasks;
+    }
+    for (const auto& group : groups) {
+        for (Candidate* candidate : group.files) {
+            tasks.push_back({ &group, candidate });
+        }
+    }
+    return tasks;
+}
+
+// Bytes from the start of the next file that Background mode asks the kernel to read ahead.
+// Sequential readahead takes over once the file is being read.
+constexpr uintmax_t prefetch_length = 4 * 1024 * 1024;
+
+// Device whose queue reads a candidate; files of unknown identity share one queue
+uint64_t candidate_device(const Candidate& candidate) {
+    return candidate.has_identity ? candidate.identity.device : 0;
+}
+
+// Run hashFn for every task of a pass through the queue of its device, in order, calling tick
+// after each one; the caller waits for the results. Candidates that completed the pass before a
+// resume take their digest from the checkpoint instead.
+template<typename HashFn, typename TickFn>
+void hash_candidate_groups(DeviceQueues& queues, const std::vector<ReadTask>& tasks, CachedHashKey::Kind pass, HashFn hashFn, TickFn tick) {
+    for (const auto& [group, candidate] : tasks) {
+        if (restore_pass(*candidate, pass)) {
+            continue;
+        }
+        queues.Submit(candidate_device(*candidate), [candidate, group, pass, &hashFn] {
+            try {
+                candidate->hash = hashFn(*group, *candidate);
+                complete_pass(*candidate, pass, candidate->hash);
+            }
+            catch (const std::exception& e) {
+                candidate->error = convert_to_wstring(e.what());
+            }
+            return candidate->bytes_read;
+        });
+        tick();
+    }
+}
+
+// Hash whole small files together on the current worker and store every result in its candidate.
+// Files the cache knows are left out of the batch, and so are files that share all extents with
+// one registered before when extents are given.
+void hash_candidate_batch(const std::vector<Candidate*>& files, HashAlgorithm algorithm, const ReadOptions& read_options, ScanCache* cache, const CachedHashKey& key,
+    ExtentRegistry* extents = nullptr) {
+    try {
+        std::vector<Candidate*> misses;
+        std::vector<fs::path> paths;
+        misses.reserve(files.size());
+        paths.reserve(files.size());
+        for (Candidate* candidate : files) {
+            if (extents) {
+                candidate->shares_extents_with = extents->Register(*candidate);
+                if (candidate->shares_extents_with) {
+                    candidate->bytes_read = 0;
+                    continue;
+                }
+            }
+            if (auto digest = lookup_cached_hash(cache, *candidate, key)) {
+                candidate->hash = *digest;
+                candidate->bytes_read = 0;
+                complete_pass(*candidate, key.kind, *digest);
+                continue;
+            }
+            misses.push_back(candidate);
+            paths.push_back(candidate->path);
+        }
+
+        auto results = compute_file_hashes(paths, algorithm, read_options);
+        for (size_t i = 0; i < misses.size(); ++i) {
+            misses[i]->hash = results[i].hash;
+            misses[i]->bytes_read = results[i].bytes_read;
+            if (!results[i].error.empty()) {
+                misses[i]->error = convert_to_wstring(results[i].error.c_str());
+                continue;
+            }
+            store_cached_hash(cache, *misses[i], key, results[i].hash);
+            complete_pass(*misses[i], key.kind, results[i].hash);
+        }
+    }
+    catch (const std::exception& e) {
+        for (Candidate* candidate : files) {
+            candidate->error = convert_to_wstring(e.what());
+        }
+    }
+}
+
+// Compare the files of a group in lockstep on the current worker and give every file that matched
+// another the digest of their content. The comparison is skipped when the cache knows every file.
+void compare_candidate_group(const std::vector<Candidate*>& files, uintmax_t size, HashAlgorithm algorithm, const ReadOptions& read_options, ScanCache* cache,
+    const CachedHashKey& key) {
+    for (Candidate* candidate : files) {
+        candidate->compared = true;
+        candidate->bytes_read = 0;
+    }
+
+    try {
+        std::vector<Digest> cached;
+        for (Candidate* candidate : files) {
+            auto digest = lookup_cached_hash(cache, *candidate, key);
+            if (!digest) {
+                break;
+            }
+            cached.push_back(*digest);
+        }
+        if (cached.size() == files.size()) {
+            for (size_t i = 0; i < files.size(); ++i) {
+                files[i]->hash = cached[i];
+                complete_pass(*files[i], key.kind, cached[i]);
+            }
+            return;
+        }
+
+        std::vector<fs::path> paths;
+        paths.reserve(files.size());
+        for (const Candidate* candidate : files) {
+            paths.push_back(candidate->path);
+        }
+
+        auto result = compare_files(paths, size, algorithm, read_options);
+        for (size_t i = 0; i < files.size(); ++i) {
+            files[i]->unique = true;
+            files[i]->bytes_read = result.bytes_read[i];
+            if (!result.errors[i].empty()) {
+                files[i]->error = convert_to_wstring(result.errors[i].c_str());
+            }
+        }
+        for (const auto& group : result.groups) {
+            for (size_t i : group.files) {
+                files[i]->unique = false;
+                files[i]->hash = group.hash;
+                store_cached_hash(cache, *files[i], key, group.hash);
+            }
+        }
+        for (Candidate* candidate : files) {
+            if (candidate->error.empty()) {
+                complete_pass(*candidate, key.kind, candidate->hash, candidate->unique);
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        for (Candidate* candidate : files) {
+            candidate->error = convert_to_wstring(e.what());
+        }
+    }
+}
+
+// Post a line of text to the log, unless its level is compiled out
+void post_message(LogPipeline& logger, LogLevel level, std::wstring text) {
+    if (is_log_enabled(level)) {
+        logger.Post({ level, LogEvent::Message, {}, std::move(text) });
+    }
+}
+
+// Split every group by the hash its candidates got in the last pass and drop the files left
+// without a pair. Runs on the calling thread once the pass is complete, which also keeps the
+// order of files inside a group identical to the single-threaded scan.
+std::vector<CandidateGroup> split_candidate_groups(const std::vector<CandidateGroup>& groups, LogPipeline& logger) {
+    std::vector<CandidateGroup> result;
+
+    for (const auto& group : groups) {
+        std::vector<Digest> order;
+        std::unordered_map<Digest, std::vector<Candidate*>, DigestHash> hash_to_files;
+        for (Candidate* candidate : group.files) {
+            if (!candidate->error.empty()) {
+                logger.Post({ LogLevel::Error, LogEvent::FileError, candidate->path, candidate->error });
+                continue;
+            }
+            auto& files = hash_to_files[candidate->hash];
+            if (files.empty()) {
+                order.push_back(candidate->hash);
+            }
+            files.push_back(candidate);
+        }
+
+        for (const auto& hash : order) {
+            auto& files = hash_to_files[hash];
+            if (files.size() > 1) {
+                result.push_back({ group.size, hash, std::move(files) });
+            }
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+DuplicateMap find_duplicate_files(const std::vector<fs::path>& roots, const ScanOptions& options, ScanSummary& summary, LogCallback logCallback) {
+    // Every log line goes through the pipeline, which calls logCallback with batches of them from
+    // a thread of its own; it is flushed when the scan returns or throws
+    LogPipeline logger(std::move(logCallback));
+
+    DuplicateMap hash_to_files;
+    summary = ScanSummary{};
+
+    ThreadPool pool(options.thread_count);
+    summary.thread_count = pool.GetThreadCount();
+    DeviceQueues device_queues(pool, options.device_concurrency, options.rotational_device_concurrency);
+
+    // The pressure controller shrinks and grows the reads of all devices together while the scan runs
+    std::optional<PressureController> pressure_controller;
+    if (options.io_pressure_ceiling > 0) {
+        const fs::path pressure_file = options.io_pressure_file.empty() ? default_io_pressure_file() : options.io_pressure_file;
+        if (pressure_file.empty()) {
+            post_message(logger, LogLevel::Info, L"I/O pressure information is not available, reads are not adapted to it\r\n");
+        }
+        else {
+            pressure_controller.emplace(pressure_file, options.io_pressure_ceiling, pool.GetThreadCount(),
+                [&device_queues](unsigned limit) { device_queues.SetTotalLimit(limit); });
+        }
+    }
+
+    // Every digest goes through the cache, so an unchanged file is never read twice across scans
+    std::optional<ScanCache> scan_cache;
+    if (!options.hash_cache_file.empty()) {
+        scan_cache.emplace();
+        try {
+            scan_cache->cache.Load(options.hash_cache_file);
+        }
+        catch (const std::exception& e) {
+            post_message(logger, LogLevel::Error, L"Ignoring hash cache: " + convert_to_wstring(e.what()) + L"\r\n");
+        }
+    }
+    ScanCache* cache = scan_cache ? &*scan_cache : nullptr;
+
+    const CachedHashKey head_tail_key{ CachedHashKey::Kind::HeadTail, options.hash_algorithm, options.head_block_size, options.tail_block_size };
+    const CachedHashKey middle_key{ CachedHashKey::Kind::Middle, options.hash_algorithm, options.middle_block_size, 0 };
+    const CachedHashKey full_key{ CachedHashKey::Kind::Full, options.hash_algorithm, 0, 0 };
+    // Counters for another thread to follow the scan; a scan nobody follows keeps them to itself
+    ScanProgress own_progress;
+    ScanProgress& progress = options.progress ? *options.progress : own_progress;
+    const ReadOptions read_options{ options.read_mode, options.throttle, options.progress ? &progress.bytes_read : nullptr, options.cancel };
+
+    const auto covered_by_head_tail = [&](uintmax_t size) {
+        return size <= options.head_block_size + options.tail_block_size;
+    };
+
+    // Hash of the head and tail blocks. For files no larger than both blocks together the ranges
+    // cover the whole file, so the result is the full hash.
+    const auto head_tail_hash = [&](const Candidate& candidate) {
+        const uintmax_t head = std::min(candidate.size, options.head_block_size);
+        const uintmax_t tail_offset = std::max(head, candidate.size - std::min(candidate.size, options.tail_block_size));
+        uintmax_t bytes_read = 0;
+        auto hash = compute_partial_hash(candidate.path, { { 0, head }, { tail_offset, candidate.size - tail_offset } }, bytes_read, options.hash_algorithm,
+            read_options);
+        return std::make_pair(hash, bytes_read);
+    };
+
+    const auto batched = [&](uintmax_t size) {
+        return options.batch_hash_max_size > 0 && options.batch_hash_files > 1 && size <= options.batch_hash_max_size;
+    };
+
+    std::optional<ExtentRegistry> extent_registry;
+    if (options.detect_shared_extents) {
+        extent_registry.emplace();
+    }
+
+    // Small files are collected on the calling thread, one batch per device, and handed to the
+    // queue of their device batch by batch, so that they keep to its limits like any other read.
+    // The head/tail pass checks their extents there, as it does for the files it reads one by one.
+    std::map<uint64_t, std::vector<Candidate*>> pending_batches;
+    const auto submit_batch = [&](uint64_t device, std::vector<Candidate*>& files, const CachedHashKey& key) {
+        summary.batch_hashed_files += files.size();
+        ExtentRegistry* extents = extent_registry && key.kind == CachedHashKey::Kind::HeadTail ? &*extent_registry : nullptr;
+        device_queues.Submit(device, [files = std::move(files), &options, &read_options, cache, key, extents] {
+            hash_candidate_batch(files, options.hash_algorithm, read_options, cache, key, extents);
+            uintmax_t bytes = 0;
+            for (const Candidate* candidate : files) {
+                bytes += candidate->bytes_read;
+            }
+            return bytes;
+        });
+        files.clear();
+    };
+    const auto flush_batch = [&](const CachedHashKey& key) {
+        for (auto& [device, files] : pending_batches) {
+            if (!files.empty()) {
+                submit_batch(device, files, key);
+            }
+        }
+    };
+    const auto add_to_batch = [&](Candidate* candidate, const CachedHashKey& key) {
+        const uint64_t device = candidate_device(*candidate);
+        auto& files = pending_batches[device];
+        files.push_back(candidate);
+        if (files.size() >= options.batch_hash_files) {
+            submit_batch(device, files, key);
+        }
+    };
+
+    const auto submit_head_tail = [&](Candidate* candidate) {
+        // The head/tail hash of a file covered by both blocks is its full hash
+        if (covered_by_head_tail(candidate->size) && batched(candidate->size)) {
+            add_to_batch(candidate, head_tail_key);
+            return;
+        }
+        device_queues.Submit(candidate_device(*candidate), [candidate, &head_tail_hash, cache, &head_tail_key, extents = extent_registry ? &*extent_registry : nullptr] {
+            try {
+                // A file that shares all its extents with one seen before is not read at all
+                if (extents) {
+                    candidate->shares_extents_with = extents->Register(*candidate);
+                    if (candidate->shares_extents_with) {
+                        return uintmax_t{ 0 };
+                    }
+                }
+                candidate->hash = cached_hash(cache, *candidate, head_tail_key, [&] {
+                    Digest hash;
+                    std::tie(hash, candidate->bytes_read) = head_tail_hash(*candidate);
+                    return hash;
+                    });
+                complete_pass(*candidate, CachedHashKey::Kind::HeadTail, candidate->hash);
+            }
+            catch (const std::exception& e) {
+                candidate->error = convert_to_wstring(e.what());
+            }
+            return candidate->bytes_read;
+        });
+    };
+
+    // Reads are either issued as the traversal goes or, ordered by physical offset, once it is done.
+    // The issue order is kept whenever it is sorted or measured.
+    const bool by_physical_offset = options.read_order == ReadOrder::PhysicalOffset;
+    SeekMeter seek_meter;
+    std::vector<Candidate*> head_tail_order;
+    const auto issue_head_tail = [&](Candidate* candidate) {
+        progress.candidate_files.fetch_add(1, std::memory_order_relaxed);
+        if (restore_pass(*candidate, CachedHashKey::Kind::HeadTail)) {
+            return;
+        }
+        progress.bytes_expected.fetch_add(std::min(candidate->size, options.head_block_size + options.tail_block_size), std::memory_order_relaxed);
+        if (by_physical_offset || options.measure_seek_distance) {
+            head_tail_order.push_back(candidate);
+        }
+        if (!by_physical_offset) {
+            submit_head_tail(candidate);
+        }
+    };
+
+    // First pass: bucket files by size. A file with a unique size can't have a duplicate,
+    // so it never has to be opened. The traversal streams files in while it is still walking,
+    // and as soon as a size is seen twice its files are handed to the workers for the head/tail
+    // pass.
+    std::deque<Candidate> candidates;
+    std::unordered_map<uintmax_t, std::vector<Candidate*>> size_to_files;
+    std::vector<uintmax_t> size_order;
+
+    // Hard links to one file share its size, so they only need to be told apart once a size is
+    // seen twice. A candidate with more than one link is registered under its inode, and a later
+    // path to the same inode is folded into it instead of becoming a candidate of its own.
+    std::unordered_map<InodeKey, Candidate*, InodeKeyHash> inode_to_candidate;
+    const auto register_inode = [&](Candidate* candidate) -> Candidate* {
+        if (candidate->link_count == 1) {
+            return nullptr;
+        }
+        if (!candidate->has_identity) {
+            candidate->has_identity = get_file_identity(candidate->path, candidate->identity);
+            if (!candidate->has_identity) {
+                return nullptr;
+            }
+        }
+        auto [it, inserted] = inode_to_candidate.try_emplace({ candidate->identity.device, candidate->identity.inode }, candidate);
+        return inserted ? nullptr : it->second;
+    };
+
+    const auto add_candidate = [&](Candidate* candidate) {
+        auto& files = size_to_files[candidate->size];
+        if (files.size() == 1) {
+            register_inode(files[0]);
+        }
+        if (!files.empty()) {
+            if (Candidate* target = register_inode(candidate)) {
+                ++summary.hard_link_files;
+                target->links.push_back(std::move(candidate->path));
+                candidates.pop_back();
+                return;
+            }
+        }
+        if (files.empty()) {
+            size_order.push_back(candidate->size);
+        }
+        files.push_back(candidate);
+        if (files.size() == 2) {
+            issue_head_tail(files[0]);
+        }
+        if (files.size() >= 2) {
+            issue_head_tail(candidate);
+        }
+    };
+
+    // Checkpoints list every file found so far with the passes it completed, which the workers
+    // keep setting while the checkpoint is written
+    const bool checkpointing = !options.checkpoint_file.empty();
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    const auto write_checkpoint = [&](const std::vector<fs::path>& frontier) {
+        try {
+            ScanCheckpointWriter writer(options.checkpoint_file,
+                { roots, options.hash_algorithm, options.head_block_size, options.tail_block_size, options.middle_block_size, frontier });
+            for (const auto& candidate : candidates) {
+                CheckpointFile file{ candidate.path, candidate.size, candidate.link_count, candidate.links,
+                    candidate.passes.load(std::memory_order_acquire), {}, {}, {}, {} };
+                if (file.passes != 0) {
+                    file.identity = candidate.digests->identity;
+                    file.head_tail = candidate.digests->head_tail;
+                    if (file.passes & CheckpointFile::MiddlePass) {
+                        file.middle = candidate.digests->middle;
+                    }
+                    if (file.passes & CheckpointFile::FullPass) {
+                        file.full = candidate.digests->full;
+                    }
+                }
+                writer.Add(file);
+            }
+            writer.Commit();
+        }
+        catch (const std::exception& e) {
+            post_message(logger, LogLevel::Error, L"Failed to write checkpoint: " + convert_to_wstring(e.what()) + L"\r\n");
+        }
+        last_checkpoint = std::chrono::steady_clock::now();
+    };
+    const auto checkpoint_due = [&] {
+        return checkpointing && std::chrono::steady_clock::now() - last_checkpoint >= options.checkpoint_interval;
+    };
+
+    // Only a complete scan has seen every file it could need a digest of again, so only it
+    // prunes the rest
+    const auto save_cache = [&](bool complete) {
+        if (!cache) {
+            return;
+        }
+        try {
+            if (complete) {
+                cache->cache.Prune();
+            }
+            cache->cache.Save(options.hash_cache_file);
+        }
+        catch (const std::exception& e) {
+            post_message(logger, LogLevel::Error, L"Failed to save hash cache: " + convert_to_wstring(e.what()) + L"\r\n");
+        }
+    };
+
+    // A cancelled scan lets the reads in flight fail, keeps what was complete in the checkpoint and
+    // the hash cache and leaves by throwing ScanCancelled
+    const auto stop_if_cancelled = [&](const std::vector<fs::path>& frontier) {
+        if (!options.cancel || !options.cancel->IsCancelled()) {
+            return;
+        }
+        pool.Wait();
+        if (checkpointing) {
+            write_checkpoint(frontier);
+        }
+        save_cache(false);
+        throw ScanCancelled();
+    };
+    // Called between reads handed to the workers once the traversal is done, and while waiting
+    // for them
+    const auto tick = [&] {
+        stop_if_cancelled({});
+        if (checkpoint_due()) {
+            write_checkpoint({});
+        }
+    };
+    const auto wait_for_pass = [&] {
+        while (!pool.WaitFor(std::chrono::seconds(1))) {
+            tick();
+        }
+        stop_if_cancelled({});
+    };
+
+    // Directories the traversal has yet to walk: the roots, or what the checkpoint left of them
+    std::vector<fs::path> frontier = roots;
+    if (options.resume) {
+        if (!checkpointing) {
+            throw std::runtime_error("Resuming a scan needs its checkpoint file");
+        }
+        ScanCheckpoint checkpoint = load_scan_checkpoint(options.checkpoint_file);
+        const CheckpointHeader& header = checkpoint.header;
+        if (header.roots != roots || header.hash_algorithm != options.hash_algorithm || header.head_block_size != options.head_block_size
+            || header.tail_block_size != options.tail_block_size || header.middle_block_size != options.middle_block_size) {
+            throw std::runtime_error("Checkpoint was written for other roots or hashing options: " + options.checkpoint_file.string());
+        }
+        frontier = std::move(checkpoint.header.frontier);
+
+        // Files are added again in the order they were found, and keep the digests of their passes
+        // as long as they didn't change since
+        uintmax_t restored_files = 0;
+        for (auto& file : checkpoint.files) {
+            std::error_code error;
+            const uintmax_t size = fs::file_size(file.path, error);
+            if (error) {
+                continue;
+            }
+            summary.files_seen += 1 + file.links.size();
+            summary.hard_link_files += file.links.size();
+            progress.entries_seen.fetch_add(1 + file.links.size(), std::memory_order_relaxed);
+            progress.bytes_seen.fetch_add(size, std::memory_order_relaxed);
+
+            Candidate* candidate = &candidates.emplace_back();
+            candidate->path = std::move(file.path);
+            candidate->size = size;
+            candidate->link_count = file.link_count;
+            candidate->links = std::move(file.links);
+            candidate->keep_digests = true;
+            candidate->has_identity = get_file_identity(candidate->path, candidate->identity);
+            // Passes restored below never go through the cache, whose entry must still survive
+            // the prune at the end of the scan
+            if (cache && candidate->has_identity) {
+                cache->cache.Touch(candidate->identity);
+            }
+            if (file.passes != 0 && candidate->has_identity && candidate->identity == file.identity) {
+                candidate->digests = std::make_unique<PassDigests>(PassDigests{ file.identity, file.head_tail, file.middle, file.full });
+                candidate->passes.store(file.passes, std::memory_order_relaxed);
+                ++restored_files;
+            }
+            add_candidate(candidate);
+        }
+        post_message(logger, LogLevel::Info, L"Resumed scan: " + std::to_wstring(checkpoint.files.size()) + L" files from the checkpoint, "
+            + std::to_wstring(restored_files) + L" with completed passes, " + std::to_wstring(frontier.size()) + L" directories left\r\n");
+    }
+
+    // The traversal pauses for every checkpoint and goes on from the directories it left
+    while (!frontier.empty()) {
+        ParallelTraverser traverser(frontier, options.traversal_thread_count, options.traversal_backend);
+        summary.traversal_thread_count = traverser.GetThreadCount();
+
+        bool paused = false;
+        TraversalBatch batch;
+        while (traverser.Next(batch)) {
+            for (const auto& error : batch.errors) {
+                logger.Post({ LogLevel::Error, LogEvent::FileError, error.path, convert_to_wstring(error.error.message().c_str()) });
+            }
+            uintmax_t batch_bytes = 0;
+            for (const auto& entry : batch.files) {
+                batch_bytes += entry.size;
+            }
+            progress.entries_seen.fetch_add(batch.files.size() + batch.directories, std::memory_order_relaxed);
+            progress.bytes_seen.fetch_add(batch_bytes, std::memory_order_relaxed);
+
+            for (auto& entry : batch.files) {
+                ++summary.files_seen;
+
+                Candidate* candidate = &candidates.emplace_back();
+                candidate->path = std::move(entry.path);
+                candidate->size = entry.size;
+                candidate->identity = entry.identity;
+                candidate->has_identity = entry.has_identity;
+                candidate->link_count = entry.link_count;
+                candidate->keep_digests = checkpointing;
+                add_candidate(candidate);
+            }
+
+            if (!paused && ((options.cancel && options.cancel->IsCancelled()) || checkpoint_due())) {
+                traverser.Pause();
+                paused = true;
+            }
+        }
+        frontier = traverser.GetFrontier();
+        stop_if_cancelled(frontier);
+        if (paused) {
+            write_checkpoint(frontier);
+        }
+    }
+    progress.stage.store(ScanStage::HeadTail, std::memory_order_relaxed);
+    if (by_physical_offset) {
+        sort_by_physical_offset(head_tail_order);
+        for (Candidate* candidate : head_tail_order) {
+            submit_head_tail(candidate);
+            tick();
+        }
+    }
+    flush_batch(head_tail_key);
+    wait_for_pass();
+    // Cached and shared files read less than expected; from here on only the next passes count
+    progress.bytes_expected.store(progress.bytes_read.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    if (options.measure_seek_distance) {
+        seek_meter.Record(head_tail_order);
+    }
+
+    std::vector<CandidateGroup> groups;
+    for (uintmax_t size : size_order) {
+        auto& files = size_to_files[size];
+        if (files.size() < 2) {
+            ++summary.files_skipped_by_size;
+            summary.bytes_skipped_by_size += size;
+            continue;
+        }
+
+        // Files that share all extents with another candidate go along with it from here on
+        if (extent_registry) {
+            std::erase_if(files, [&](Candidate* candidate) {
+                if (!candidate->shares_extents_with) {
+                    return false;
+                }
+                ++summary.shared_extent_files;
+                candidate->shares_extents_with->extent_sharers.push_back(candidate->path);
+                return true;
+            });
+            if (files.size() < 2) {
+                continue;
+            }
+        }
+        summary.candidate_files += files.size();
+        summary.head_tail_files += files.size();
+        for (const Candidate* candidate : files) {
+            summary.head_tail_bytes += candidate->bytes_read;
+        }
+        groups.push_back({ size, Digest(), std::move(files) });
+    }
+
+    // Second pass: split same-size groups by the hash of the head and tail blocks
+    groups = split_candidate_groups(groups, logger);
+
+    // Third pass: split the survivors by the hash of a block from the middle of the file
+    if (options.middle_block_size > 0) {
+        progress.stage.store(ScanStage::Middle, std::memory_order_relaxed);
+        const auto tasks = schedule_reads(groups, by_physical_offset);
+        for (const auto& [group, candidate] : tasks) {
+            if (!covered_by_head_tail(group->size) && !has_restored_pass(*candidate, CachedHashKey::Kind::Middle)) {
+                progress.bytes_expected.fetch_add(std::min(group->size, options.middle_block_size), std::memory_order_relaxed);
+            }
+        }
+        hash_candidate_groups(device_queues, tasks, CachedHashKey::Kind::Middle, [&](const CandidateGroup& group, Candidate& candidate) {
+            if (covered_by_head_tail(group.size)) {
+                return group.hash;
+            }
+            const uintmax_t length = std::min(group.size, options.middle_block_size);
+            candidate.bytes_read = 0;
+            return cached_hash(cache, candidate, middle_key, [&] {
+                return compute_partial_hash(candidate.path, { { (group.size - length) / 2, length } }, candidate.bytes_read, options.hash_algorithm,
+                    read_options);
+                });
+            }, tick);
+        wait_for_pass();
+        progress.bytes_expected.store(progress.bytes_read.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        if (options.measure_seek_distance) {
+            std::vector<Candidate*> order;
+            for (const auto& [group, candidate] : tasks) {
+                if (!covered_by_head_tail(group->size)) {
+                    order.push_back(candidate);
+                }
+            }
+            seek_meter.Record(order);
+        }
+
+        for (const auto& group : groups) {
+            if (!covered_by_head_tail(group.size)) {
+                summary.middle_files += group.files.size();
+                for (const Candidate* candidate : group.files) {
+                    summary.middle_bytes += candidate->bytes_read;
+                }
+            }
+        }
+        groups = split_candidate_groups(groups, logger);
+    }
+
+    // Final pass: full hash or comparison of every file that survived all partial passes
+    progress.stage.store(ScanStage::Full, std::memory_order_relaxed);
+    std::unordered_map<Digest, uintmax_t, DigestHash> hash_to_size;
+    std::vector<CandidateGroup> full_hash_groups;
+    for (auto& group : groups) {
+        if (covered_by_head_tail(group.size)) {
+            // Hashed whole already, so the group is confirmed
+            progress.groups_confirmed.fetch_add(1, std::memory_order_relaxed);
+            hash_to_size[group.hash] = group.size;
+            auto& files = hash_to_files[group.hash];
+            for (const Candidate* candidate : group.files) {
+                files.push_back(candidate->path);
+            }
+        }
+        else {
+            for (const Candidate* candidate : group.files) {
+                if (!(candidate->passes.load(std::memory_order_relaxed) & (CheckpointFile::FullPass | CheckpointFile::UniquePass))) {
+                    progress.bytes_expected.fetch_add(group.size, std::memory_order_relaxed);
+                }
+            }
+            full_hash_groups.push_back(std::move(group));
+        }
+    }
+
+    // Large files are read through io_uring when the kernel allows it, so that many reads are in
+    // flight at once; otherwise every worker reads its own file with blocking reads. The io_uring
+    // reads only finish all together, so checkpoints leave them to the workers.
+    const bool use_uring = options.io_queue_depth > 0 && !pressure_controller && !checkpointing && is_uring_available();
+    std::vector<ReadTask> uring_reads;
+
+    // Small groups are compared rather than hashed when asked to, so that reading stops at the
+    // first block that tells them apart. Their files are read in lockstep, so only the other groups
+    // are ordered file by file.
+    std::vector<CandidateGroup> hashed_groups;
+    std::vector<Candidate*> full_order;
+    for (const auto& group : full_hash_groups) {
+        if (options.full_pass_mode == FullPassMode::Compare && group.files.size() <= options.compare_group_limit) {
+            if (restore_comparison(group.files)) {
+                continue;
+            }
+            if (options.measure_seek_distance) {
+                full_order.insert(full_order.end(), group.files.begin(), group.files.end());
+            }
+            device_queues.Submit(candidate_device(*group.files.front()), [files = group.files, size = group.size, &options, &read_options, cache, &full_key] {
+                compare_candidate_group(files, size, options.hash_algorithm, read_options, cache, full_key);
+                uintmax_t bytes = 0;
+                for (const Candidate* candidate : files) {
+                    bytes += candidate->bytes_read;
+                }
+                return bytes;
+            });
+            tick();
+            continue;
+        }
+        hashed_groups.push_back(group);
+    }
+
+    // Files the workers read one by one. In Background mode every one of them asks the kernel to
+    // start reading the file that is a worker count behind it, which is the one most likely to be
+    // taken next once all workers are busy.
+    std::vector<ReadTask> worker_reads;
+    {
+        const auto tasks = schedule_reads(hashed_groups, by_physical_offset);
+        for (const auto& [group, candidate] : tasks) {
+            if (restore_pass(*candidate, CachedHashKey::Kind::Full)) {
+                continue;
+            }
+            if (options.measure_seek_distance) {
+                full_order.push_back(candidate);
+            }
+            if (batched(group->size)) {
+                add_to_batch(candidate, full_key);
+                continue;
+            }
+            // Sparse files go to compute_file_hash, which skips their holes instead of reading them.
+            // So do files on devices with a concurrency limit, which io_uring wouldn't keep.
+            if (use_uring && !device_queues.IsLimited(candidate_device(*candidate)) && !is_sparse_file(candidate->path)) {
+                if (auto digest = lookup_cached_hash(cache, *candidate, full_key)) {
+                    candidate->hash = *digest;
+                    candidate->bytes_read = 0;
+                    continue;
+                }
+                uring_reads.push_back({ group, candidate });
+                continue;
+            }
+            worker_reads.push_back({ group, candidate });
+        }
+    }
+    flush_batch(full_key);
+
+    const auto submit_worker_reads = [&](const std::vector<ReadTask>& reads) {
+        for (size_t i = 0; i < reads.size(); ++i) {
+            const auto& [group, candidate] = reads[i];
+            const ReadTask* next = i + pool.GetThreadCount() < reads.size() ? &reads[i + pool.GetThreadCount()] : nullptr;
+            if (options.read_mode != ReadMode::Background) {
+                next = nullptr;
+            }
+            device_queues.Submit(candidate_device(*candidate), [candidate, next, size = group->size, &options, &read_options, cache, &full_key] {
+                if (next) {
+                    prefetch_file(next->candidate->path, std::min(next->group->size, prefetch_length), options.read_mode);
+                }
+                try {
+                    candidate->bytes_read = 0;
+                    candidate->hash = cached_hash(cache, *candidate, full_key, [&] {
+                        candidate->bytes_read = size;
+                        return compute_file_hash(candidate->path, options.hash_algorithm, options.mmap_threshold, read_options);
+                        });
+                    complete_pass(*candidate, CachedHashKey::Kind::Full, candidate->hash);
+                }
+                catch (const std::exception& e) {
+                    candidate->error = convert_to_wstring(e.what());
+                }
+                return candidate->bytes_read;
+            });
+            tick();
+        }
+    };
+    submit_worker_reads(worker_reads);
+
+    // An io_uring that can't be set up, for lack of locked memory or a queue depth the kernel
+    // refuses, leaves its files to the workers
+    std::vector<ReadTask> uring_fallback_reads;
+    if (!uring_reads.empty()) {
+        summary.uring_files = uring_reads.size();
+        std::vector<fs::path> uring_paths;
+        for (const auto& read : uring_reads) {
+            uring_paths.push_back(read.candidate->path);
+        }
+        try {
+            auto results = compute_file_hashes_uring(uring_paths, options.hash_algorithm, options.io_queue_depth, pool, read_options);
+            for (size_t i = 0; i < uring_reads.size(); ++i) {
+                Candidate* candidate = uring_reads[i].candidate;
+                candidate->hash = results[i].hash;
+                candidate->bytes_read = results[i].bytes_read;
+                if (!results[i].error.empty()) {
+                    candidate->error = convert_to_wstring(results[i].error.c_str());
+                    continue;
+                }
+                store_cached_hash(cache, *candidate, full_key, results[i].hash);
+            }
+        }
+        catch (const std::exception& e) {
+            post_message(logger, LogLevel::Error, L"io_uring failed, reading with the workers instead: " + convert_to_wstring(e.what()) + L"\r\n");
+            summary.uring_files = 0;
+            uring_fallback_reads = std::move(uring_reads);
+            submit_worker_reads(uring_fallback_reads);
+        }
+    }
+    wait_for_pass();
+    summary.devices = device_queues.GetStats();
+    if (pressure_controller) {
+        pressure_controller->Stop();
+        summary.lowest_read_limit = pressure_controller->GetLowestLimit();
+        summary.read_limit_changes = pressure_controller->GetChanges();
+    }
+    if (options.measure_seek_distance) {
+        seek_meter.Record(full_order);
+        summary.seek_distance = seek_meter.distance;
+        summary.seek_count = seek_meter.seeks;
+    }
+
+    for (const auto& group : full_hash_groups) {
+        for (const Candidate* candidate : group.files) {
+            if (!candidate->error.empty()) {
+                logger.Post({ LogLevel::Error, LogEvent::FileError, candidate->path, candidate->error });
+                continue;
+            }
+            if (candidate->compared) {
+                if constexpr (is_log_enabled(LogLevel::Debug)) {
+                    logger.Post({ LogLevel::Debug, LogEvent::FileCompared, candidate->path, {} });
+                }
+                ++summary.compared_files;
+                summary.compared_bytes += candidate->bytes_read;
+                if (candidate->unique) {
+                    continue;
+                }
+            }
+            else {
+                if constexpr (is_log_enabled(LogLevel::Debug)) {
+                    logger.Post({ LogLevel::Debug, LogEvent::FileHashed, candidate->path, {} });
+                }
+                ++summary.full_hash_files;
+                summary.full_hash_bytes += candidate->bytes_read;
+            }
+            hash_to_size[candidate->hash] = group.size;
+            hash_to_files[candidate->hash].push_back(candidate->path);
+        }
+    }
+
+    if (cache) {
+        summary.cache_hits = cache->hits;
+        summary.cache_misses = cache->misses;
+    }
+    save_cache(true);
+    // The scan is complete, so there is nothing left to resume
+    if (checkpointing) {
+        std::error_code error;
+        fs::remove(options.checkpoint_file, error);
+    }
+
+    // Remove entries with only one file (unique files)
+    for (auto it = hash_to_files.begin(); it != hash_to_files.end();) {
+        if (it->second.size() < 2) {
+            it = hash_to_files.erase(it);
+        }
+        else {
+            summary.reclaimable_bytes += hash_to_size[it->first] * (it->second.size() - 1);
+            ++it;
+        }
+    }
+    progress.groups_confirmed.store(hash_to_files.size(), std::memory_order_relaxed);
+    progress.bytes_expected.store(progress.bytes_read.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    progress.stage.store(ScanStage::Done, std::memory_order_relaxed);
+
+    for (auto& candidate : candidates) {
+        if (!candidate.links.empty()) {
+            HardLinkSet links{ candidate.path };
+            links.insert(links.end(), std::make_move_iterator(candidate.links.begin()), std::make_move_iterator(candidate.links.end()));
+            summary.hard_link_sets.push_back(std::move(links));
+        }
+        if (!candidate.extent_sharers.empty()) {
+            SharedExtentSet sharers{ candidate.path };
+            sharers.insert(sharers.end(), candidate.extent_sharers.begin(), candidate.extent_sharers.end());
+            summary.shared_extent_sets.push_back(std::move(sharers));
+        }
+    }
+
+    post_message(logger, LogLevel::Info, L"Scanned " + std::to_wstring(summary.files_seen) + L" files, " + std::to_wstring(summary.candidate_files)
+        + L" candidates. Size pass skipped " + std::to_wstring(summary.files_skipped_by_size) + L" files ("
+        + std::to_wstring(summary.bytes_skipped_by_size) + L" bytes not read)\r\n");
+    post_message(logger, LogLevel::Info, L"Head/tail pass: " + std::to_wstring(summary.head_tail_files) + L" files, " + std::to_wstring(summary.head_tail_bytes)
+        + L" bytes read. Middle pass: " + std::to_wstring(summary.middle_files) + L" files, " + std::to_wstring(summary.middle_bytes)
+        + L" bytes read. Full hash: " + std::to_wstring(summary.full_hash_files) + L" files, " + std::to_wstring(summary.full_hash_bytes)
+        + L" bytes read\r\n");
+    post_message(logger, LogLevel::Info, L"Reclaimable: " + std::to_wstring(summary.reclaimable_bytes) + L" bytes. Hard links: "
+        + std::to_wstring(summary.hard_link_sets.size()) + L" sets, " + std::to_wstring(summary.hard_link_files)
+        + L" paths not read\r\n");
+    if (extent_registry) {
+        post_message(logger, LogLevel::Info, L"Shared extents: " + std::to_wstring(summary.shared_extent_sets.size()) + L" sets, "
+            + std::to_wstring(summary.shared_extent_files) + L" files not read\r\n");
+    }
+    if (summary.compared_files > 0) {
+        post_message(logger, LogLevel::Info, L"Comparison: " + std::to_wstring(summary.compared_files) + L" files, " + std::to_wstring(summary.compared_bytes)
+            + L" bytes read\r\n");
+    }
+    for (const auto& device : summary.devices) {
+        const double throughput = device.busy_seconds > 0 ? device.bytes_read / (1024.0 * 1024.0) / device.busy_seconds : 0.0;
+        post_message(logger, LogLevel::Info, L"Device " + convert_to_wstring(device_to_string(device.device).c_str()) + (device.rotational ? L" (rotational)" : L"")
+            + L": " + std::to_wstring(device.files) + L" reads, " + std::to_wstring(device.bytes_read) + L" bytes, "
+            + std::to_wstring(static_cast<uintmax_t>(throughput)) + L" MiB/s\r\n");
+    }
+    if (pressure_controller) {
+        post_message(logger, LogLevel::Info, L"I/O pressure: reads at a time went down to " + std::to_wstring(summary.lowest_read_limit) + L" of "
+            + std::to_wstring(summary.thread_count) + L", " + std::to_wstring(summary.read_limit_changes) + L" changes\r\n");
+    }
+    if (options.measure_seek_distance) {
+        post_message(logger, LogLevel::Info, L"Seeks: " + std::to_wstring(summary.seek_count) + L", average distance "
+            + std::to_wstring(summary.seek_count > 0 ? summary.seek_distance / summary.seek_count : 0) + L" bytes\r\n");
+    }
+    if (cache) {
+        post_message(logger, LogLevel::Info, L"Hash cache: " + std::to_wstring(summary.cache_hits) + L" hits, " + std::to_wstring(summary.cache_misses) + L" misses\r\n");
+    }
+
+    return hash_to_files;
+}
+
+DuplicateMap find_duplicate_files(const fs::path& root, LogCallback logCallback) {
+    ScanSummary summary;
+    return find_duplicate_files(std::vector<fs::path>{ root }, ScanOptions{}, summary, logCallback);
+}
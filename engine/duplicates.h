@@ -0,0 +1,182 @@
+#pragma once
+
+#include "device_queue.h"
+#include "hashing.h"
+#include "traversal.h"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class CancellationToken;
+struct ScanProgress;
+
+// Confirmation strategy of the final pass
+enum class FullPassMode {
+    Hash,
+    Compare,
+};
+
+// Order in which the files of a pass are handed to the workers
+enum class ReadOrder {
+    // As the traversal found them, group by group
+    Traversal,
+    // By where their data starts on the device, so that a rotational disk sweeps in one direction
+    // instead of seeking back and forth. Meant for hard disks, together with few worker threads.
+    PhysicalOffset,
+};
+
+// Tunables of the duplicate search pipeline
+struct ScanOptions {
+    // Bytes read from the start and from the end of every candidate in the first partial pass
+    uintmax_t head_block_size = 4096;
+    uintmax_t tail_block_size = 4096;
+    // Bytes read from the middle of every candidate in the second partial pass, 0 disables the pass
+    uintmax_t middle_block_size = 64 * 1024;
+    // Hashing worker threads, 0 means one per hardware thread and 1 hashes on the calling thread
+    unsigned thread_count = 0;
+    // Reads of every device wait in a queue of their own and at most this many of them are handed
+    // to the hashing workers at a time, so a slow disk holds up neither the workers nor the other
+    // devices. 0 means no limit beyond the worker count. Rotational disks, where parallel reads
+    // only add seeks, get their own limit; 0 there means the general one. Files on a limited
+    // device are read by the workers rather than through io_uring.
+    unsigned device_concurrency = 0;
+    unsigned rotational_device_concurrency = 1;
+    // Linux: keep the share of time in which some task waits for I/O, as the pressure stall
+    // information reports it, under this percentage. Above it the reads handed to the workers at
+    // a time are halved, down to one; below half of it they grow back by one at a time. 0
+    // disables the adaptation. With it, files are read by the workers rather than io_uring.
+    double io_pressure_ceiling = 0;
+    // Pressure file to watch; empty picks the cgroup of the process or the system-wide one
+    fs::path io_pressure_file;
+    // Directory traversal threads, 0 means one per hardware thread
+    unsigned traversal_thread_count = 0;
+    TraversalBackend traversal_backend = default_traversal_backend;
+    // Algorithm of the partial and full hashes; every digest in the result records it
+    HashAlgorithm hash_algorithm = HashAlgorithm::Sha256;
+    // Files up to this size are hashed whole, batch_hash_files at a time on one worker, so that
+    // SHA-256 can run them through the multi-buffer kernel. 0 disables batching.
+    uintmax_t batch_hash_max_size = 64 * 1024;
+    unsigned batch_hash_files = 16;
+    // Full hashes of regular files at least this large read memory-mapped windows, 0 disables mmap
+    uintmax_t mmap_threshold = default_mmap_threshold;
+    // Reads kept in flight through io_uring for the full hashes of files above the batch size.
+    // Where io_uring is unavailable the workers read with blocking calls. 0 disables io_uring.
+    unsigned io_queue_depth = 64;
+    // How the final pass confirms the candidates left by the partial passes: by their full hashes,
+    // or by comparing groups of up to compare_group_limit files in lockstep, which stops reading
+    // as soon as they differ and hashes one file per set of identical ones. Larger groups are
+    // hashed either way, since comparing needs all of their files open at once.
+    FullPassMode full_pass_mode = FullPassMode::Hash;
+    unsigned compare_group_limit = 3;
+    // Linux only: query the extent map of every candidate before reading it and fold files whose
+    // data is all shared at the same locations, like reflink copies on btrfs or XFS, into one
+    // candidate. Small files hashed in batches are checked as well.
+    bool detect_shared_extents = false;
+    // Order of the reads of every pass. With PhysicalOffset the head/tail pass waits for the
+    // traversal to finish so that it can sort all candidates first.
+    ReadOrder read_order = ReadOrder::Traversal;
+    // Background reads spare the other processes on the machine: files are opened without
+    // updating their access time where permitted, the pages the scan brought into the page cache
+    // are dropped once hashed while those cached before stay, and the workers ask the kernel to
+    // read ahead the files they'll take next
+    ReadMode read_mode = ReadMode::Normal;
+    // Bandwidth and operation limit shared by every read of the scan, none when null. Owned by
+    // the caller, which can change the limits while the scan runs.
+    IoThrottle* throttle = nullptr;
+    // Look up the physical offset of every file read and add up the distance between consecutive
+    // files into ScanSummary::seek_distance, which shows what ordering the reads saves
+    bool measure_seek_distance = false;
+    // Persistent hash cache, loaded before and saved after the scan. Empty disables the cache.
+    fs::path hash_cache_file;
+    // Counters the scan keeps up to date for another thread to follow it, none when null. Owned
+    // by the caller; ScanSession sets it up.
+    ScanProgress* progress = nullptr;
+    // Stops the scan, which throws ScanCancelled, as soon as it is cancelled; none when null.
+    // Owned by the caller.
+    const CancellationToken* cancel = nullptr;
+    // Checkpoint of the scan, written every checkpoint_interval and when it is cancelled, and
+    // removed once it finishes. It holds the traversal frontier and the passes every file
+    // completed, so a resumed scan reads neither the directories nor the files again. Empty
+    // disables checkpoints. With checkpoints the full pass reads through the workers rather than
+    // io_uring.
+    fs::path checkpoint_file;
+    std::chrono::seconds checkpoint_interval{ 60 };
+    // Continue the scan recorded in checkpoint_file, which must have been written for the same
+    // roots and hashing options. Files that changed since are read again.
+    bool resume = false;
+};
+
+// Paths that name one file through hard links, in the order the traversal found them
+using HardLinkSet = std::vector<fs::path>;
+
+// Files that share all their data blocks and so are deduplicated already, first-read file first
+using SharedExtentSet = std::vector<fs::path>;
+
+// Statistics collected while scanning for duplicates, and the hard links found on the way
+struct ScanSummary {
+    uintmax_t files_seen = 0;
+    uintmax_t candidate_files = 0;
+    uintmax_t files_skipped_by_size = 0;
+    uintmax_t bytes_skipped_by_size = 0;
+
+    // Files that went into each stage and bytes read by it
+    uintmax_t head_tail_files = 0;
+    uintmax_t head_tail_bytes = 0;
+    uintmax_t middle_files = 0;
+    uintmax_t middle_bytes = 0;
+    uintmax_t full_hash_files = 0;
+    uintmax_t full_hash_bytes = 0;
+    // Files of the head/tail and full passes that were hashed in batches
+    uintmax_t batch_hashed_files = 0;
+    // Files of the full pass read through io_uring
+    uintmax_t uring_files = 0;
+    // Files of the final pass confirmed by comparison instead of a full hash, and bytes read
+    uintmax_t compared_files = 0;
+    uintmax_t compared_bytes = 0;
+    // Paths that were folded into an earlier hard link to the same file and never read on their own
+    uintmax_t hard_link_files = 0;
+    // Candidates found to share all extents with an earlier one, which were never read
+    uintmax_t shared_extent_files = 0;
+    // Bytes freed by keeping one file of every duplicate group; hard links count once
+    uintmax_t reclaimable_bytes = 0;
+    // Digest lookups answered by the hash cache and the ones that had to read the file
+    uintmax_t cache_hits = 0;
+    uintmax_t cache_misses = 0;
+    // With measure_seek_distance: bytes between the first blocks of files read one after the other
+    // in issue order, summed over all passes, and the number of such steps
+    uintmax_t seek_distance = 0;
+    uintmax_t seek_count = 0;
+
+    unsigned thread_count = 0;
+    unsigned traversal_thread_count = 0;
+
+    // Reads that went through the per-device queues, by device. Batches of small files and
+    // io_uring reads bypass the queues and aren't counted.
+    std::vector<DeviceStats> devices;
+    // With io_pressure_ceiling: the lowest limit on reads at a time and how often it changed
+    unsigned lowest_read_limit = 0;
+    uintmax_t read_limit_changes = 0;
+
+    // Every set of two or more hard links seen by the scan, whether or not the file has duplicates
+    std::vector<HardLinkSet> hard_link_sets;
+    // Every set of candidates that share all their extents, with detect_shared_extents
+    std::vector<SharedExtentSet> shared_extent_sets;
+};
+
+// Duplicate groups keyed by the digest of their content. A file reached through several hard links
+// appears once, under the first of its paths; the others are listed in ScanSummary::hard_link_sets.
+// Files sharing all extents appear once in the same way and are listed in shared_extent_sets.
+using DuplicateMap = std::unordered_map<Digest, std::vector<fs::path>, DigestHash>;
+
+// Find duplicate files by hash under every root. The log callback gets batches of lines, several
+// times a second at most, from a thread of the scan; records above DUPFINDER_LOG_LEVEL are
+// compiled out.
+DuplicateMap find_duplicate_files(const std::vector<fs::path>& roots, const ScanOptions& options, ScanSummary& summary, LogCallback logCallback = [](std::wstring) {});
+
+DuplicateMap find_duplicate_files(const fs::path& root, LogCallback logCallback = [](std::wstring) {});
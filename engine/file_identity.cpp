@@ -0,0 +1,71 @@
+#include "file_identity.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+namespace {
+
+// FILETIME counts 100 ns intervals
+int64_t filetime_to_ns(LARGE_INTEGER time) {
+    return time.QuadPart * 100;
+}
+
+} // namespace
+
+bool get_file_identity(const fs::path& path, FileIdentity& identity) {
+    HANDLE file = ::CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info{};
+    FILE_BASIC_INFO basic{};
+    const bool ok = ::GetFileInformationByHandle(file, &info)
+        && ::GetFileInformationByHandleEx(file, FileBasicInfo, &basic, sizeof(basic));
+    ::CloseHandle(file);
+    if (!ok) {
+        return false;
+    }
+
+    identity.device = info.dwVolumeSerialNumber;
+    identity.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    identity.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    identity.mtime_ns = filetime_to_ns(basic.LastWriteTime);
+    identity.ctime_ns = filetime_to_ns(basic.ChangeTime);
+    return true;
+}
+
+#else
+
+FileIdentity file_identity_from_stat(const struct stat& st) {
+    FileIdentity identity;
+    identity.device = static_cast<uint64_t>(st.st_dev);
+    identity.inode = static_cast<uint64_t>(st.st_ino);
+    identity.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+    identity.mtime_ns = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+    identity.ctime_ns = static_cast<int64_t>(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    identity.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    identity.ctime_ns = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+    return identity;
+}
+
+bool get_file_identity(const fs::path& path, FileIdentity& identity) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+
+    identity = file_identity_from_stat(st);
+    return true;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// What identifies a file and its content version without reading it: the file ID on its device,
+// plus the size and the modification and status change times. Any write changes mtime or ctime,
+// so a file whose identity is unchanged still has the content it had when it was hashed.
+struct FileIdentity {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    int64_t ctime_ns = 0;
+
+    bool operator==(const FileIdentity& other) const = default;
+};
+
+// Read the identity of a file without opening it for reading. Returns false when the file can't
+// be queried. On Windows the inode is the NTFS file index and the device the volume serial number.
+bool get_file_identity(const fs::path& path, FileIdentity& identity);
+
+#ifndef _WIN32
+// Identity of a file from a stat result the caller already has
+FileIdentity file_identity_from_stat(const struct stat& st);
+#endif
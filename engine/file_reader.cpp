@@ -0,0 +1,331 @@
+#include "file_reader.h"
+#include "cancellation.h"
+#include "io_throttle.h"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <cerrno>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+FileReader::~FileReader() {
+    Close();
+}
+
+bool FileReader::Open(const fs::path& path, const ReadOptions& options) {
+    m_mode = options.mode;
+    m_throttle = options.throttle;
+    m_bytesRead = options.bytes_read;
+    m_cancel = options.cancel;
+    m_file.open(path, std::ios::binary);
+    return m_file.is_open();
+}
+
+bool FileReader::IsOpen() const noexcept {
+    return m_file.is_open();
+}
+
+size_t FileReader::Read(void* buffer, size_t size) {
+    if (m_cancel) {
+        m_cancel->ThrowIfCancelled();
+    }
+    if (m_throttle) {
+        m_throttle->Acquire(size);
+    }
+    m_file.read(static_cast<char*>(buffer), static_cast<std::streamsize>(size));
+    const size_t total = static_cast<size_t>(m_file.gcount());
+    if (m_throttle && total < size) {
+        m_throttle->Refund(size - total);
+    }
+    if (m_bytesRead) {
+        m_bytesRead->fetch_add(total, std::memory_order_relaxed);
+    }
+    return total;
+}
+
+bool FileReader::HasFailed() const noexcept {
+    return m_file.bad();
+}
+
+bool FileReader::Seek(uint64_t offset) {
+    m_file.clear();
+    return static_cast<bool>(m_file.seekg(static_cast<std::streamoff>(offset)));
+}
+
+void FileReader::AdviseRanged() {
+}
+
+bool FileReader::GetSize(uint64_t& size) {
+    const std::streamoff position = m_file.tellg();
+    m_file.seekg(0, std::ios::end);
+    const std::streamoff end = m_file.tellg();
+    m_file.seekg(position);
+    if (end < 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(end);
+    return true;
+}
+
+void FileReader::Close() {
+    if (m_file.is_open()) {
+        m_file.close();
+    }
+}
+
+void prefetch_file(const fs::path&, uintmax_t, ReadMode) {
+}
+
+#else
+
+int open_for_reading(const fs::path& path, ReadMode mode) {
+#ifdef O_NOATIME
+    if (mode == ReadMode::Background) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+        // Only the owner of a file may open it without updating the access time
+        if (fd >= 0 || errno != EPERM) {
+            return fd;
+        }
+    }
+#else
+    (void)mode;
+#endif
+    return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+namespace {
+
+// Residency of the prefetched range of a file as it was before the prefetch, kept until a reader
+// opens the file
+struct PrefetchedFile {
+    dev_t device;
+    ino_t inode;
+    std::vector<unsigned char> resident;
+};
+
+// Prefetches run a worker count ahead of the reads, so a few entries cover them; files that are
+// never opened after all drop out the oldest first
+constexpr size_t max_prefetched_files = 256;
+
+std::mutex prefetched_mutex;
+std::vector<PrefetchedFile> prefetched_files;
+
+// Residency of the first length bytes of an open file, without faulting any page in
+std::vector<unsigned char> query_resident_pages(int fd, uint64_t length) {
+    if (length == 0) {
+        return {};
+    }
+    void* data = ::mmap(nullptr, static_cast<size_t>(length), PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        return {};
+    }
+    const uint64_t page_size = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    std::vector<unsigned char> resident(static_cast<size_t>((length + page_size - 1) / page_size));
+    if (::mincore(data, static_cast<size_t>(length), resident.data()) != 0) {
+        resident.clear();
+    }
+    ::munmap(data, static_cast<size_t>(length));
+    return resident;
+}
+
+} // namespace
+
+std::vector<unsigned char> get_resident_pages(int fd, ReadMode mode) {
+    struct stat st;
+    if (mode != ReadMode::Background || ::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return {};
+    }
+    std::vector<unsigned char> resident = query_resident_pages(fd, static_cast<uint64_t>(st.st_size));
+    if (resident.empty()) {
+        return resident;
+    }
+
+    std::lock_guard<std::mutex> lock(prefetched_mutex);
+    auto it = std::find_if(prefetched_files.begin(), prefetched_files.end(), [&](const PrefetchedFile& file) {
+        return file.device == st.st_dev && file.inode == st.st_ino;
+    });
+    if (it != prefetched_files.end()) {
+        std::copy_n(it->resident.begin(), std::min(it->resident.size(), resident.size()), resident.begin());
+        prefetched_files.erase(it);
+    }
+    return resident;
+}
+
+void release_cached_pages(int fd, ReadMode mode, const std::vector<unsigned char>& resident) {
+#ifdef POSIX_FADV_DONTNEED
+    if (mode != ReadMode::Background) {
+        return;
+    }
+    if (resident.empty()) {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        return;
+    }
+
+    // Every run of pages that weren't cached, then whatever the file grew by since
+    const off_t page_size = static_cast<off_t>(::sysconf(_SC_PAGESIZE));
+    for (size_t page = 0; page < resident.size();) {
+        if (resident[page] & 1) {
+            ++page;
+            continue;
+        }
+        const size_t first = page;
+        while (page < resident.size() && !(resident[page] & 1)) {
+            ++page;
+        }
+        ::posix_fadvise(fd, static_cast<off_t>(first) * page_size, static_cast<off_t>(page - first) * page_size, POSIX_FADV_DONTNEED);
+    }
+    ::posix_fadvise(fd, static_cast<off_t>(resident.size()) * page_size, 0, POSIX_FADV_DONTNEED);
+#else
+    (void)fd;
+    (void)mode;
+    (void)resident;
+#endif
+}
+
+FileReader::~FileReader() {
+    Close();
+}
+
+bool FileReader::Open(const fs::path& path, const ReadOptions& options) {
+    Close();
+    m_mode = options.mode;
+    m_throttle = options.throttle;
+    m_bytesRead = options.bytes_read;
+    m_cancel = options.cancel;
+    m_failed = false;
+    m_fd = open_for_reading(path, m_mode);
+    if (m_fd < 0) {
+        return false;
+    }
+    m_resident = get_resident_pages(m_fd, m_mode);
+    return true;
+}
+
+bool FileReader::IsOpen() const noexcept {
+    return m_fd >= 0;
+}
+
+size_t FileReader::Read(void* buffer, size_t size) {
+    if (m_cancel) {
+        m_cancel->ThrowIfCancelled();
+    }
+    if (m_throttle) {
+        m_throttle->Acquire(size);
+    }
+    size_t total = 0;
+    while (total < size) {
+        const ssize_t count = ::read(m_fd, static_cast<char*>(buffer) + total, size - total);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            m_failed = true;
+            break;
+        }
+        if (count == 0) {
+            break;
+        }
+        total += static_cast<size_t>(count);
+    }
+    if (m_throttle && total < size) {
+        m_throttle->Refund(size - total);
+    }
+    if (m_bytesRead) {
+        m_bytesRead->fetch_add(total, std::memory_order_relaxed);
+    }
+    return total;
+}
+
+bool FileReader::HasFailed() const noexcept {
+    return m_failed;
+}
+
+bool FileReader::Seek(uint64_t offset) {
+    return ::lseek(m_fd, static_cast<off_t>(offset), SEEK_SET) >= 0;
+}
+
+void FileReader::AdviseRanged() {
+#ifdef POSIX_FADV_RANDOM
+    if (m_mode == ReadMode::Background) {
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_RANDOM);
+    }
+#endif
+}
+
+bool FileReader::GetSize(uint64_t& size) {
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    return true;
+}
+
+void FileReader::Close() {
+    if (m_fd >= 0) {
+        release_cached_pages(m_fd, m_mode, m_resident);
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void prefetch_file(const fs::path& path, uintmax_t length, ReadMode mode) {
+#ifdef POSIX_FADV_WILLNEED
+    const int fd = open_for_reading(path, mode);
+    if (fd < 0) {
+        return;
+    }
+
+    // The reader that opens the file later has to tell the pages cached before from these
+    struct stat st;
+    if (mode == ReadMode::Background && ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        std::vector<unsigned char> resident = query_resident_pages(fd, std::min<uint64_t>(length, static_cast<uint64_t>(st.st_size)));
+        if (!resident.empty()) {
+            std::lock_guard<std::mutex> lock(prefetched_mutex);
+            if (prefetched_files.size() >= max_prefetched_files) {
+                prefetched_files.erase(prefetched_files.begin());
+            }
+            prefetched_files.push_back({ st.st_dev, st.st_ino, std::move(resident) });
+        }
+    }
+    ::posix_fadvise(fd, 0, static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+    ::close(fd);
+#else
+    (void)path;
+    (void)length;
+    (void)mode;
+#endif
+}
+
+#endif
+
+void throttle_read(const ReadOptions& options, uint64_t bytes) {
+    if (options.throttle) {
+        options.throttle->Acquire(bytes);
+    }
+}
+
+void refund_read(const ReadOptions& options, uint64_t bytes) {
+    if (options.throttle && bytes > 0) {
+        options.throttle->Refund(bytes);
+    }
+}
+
+void count_read(const ReadOptions& options, uint64_t bytes) {
+    if (options.bytes_read) {
+        options.bytes_read->fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+void check_cancelled(const ReadOptions& options) {
+    if (options.cancel) {
+        options.cancel->ThrowIfCancelled();
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#endif
+
+namespace fs = std::filesystem;
+
+class CancellationToken;
+class IoThrottle;
+
+// How the hashing code treats the files it reads
+enum class ReadMode {
+    Normal,
+    // Leave as little trace as possible for the other processes on the machine: files are opened
+    // with O_NOATIME where the kernel permits it (the caller owns the file or has CAP_FOWNER),
+    // and the pages the read brought into the page cache are dropped once it is done. Pages that
+    // were cached before the file was opened stay, so a hot file keeps its working set; pages
+    // another process faults in while the scan reads the file go with the scan's. Linux only;
+    // elsewhere the same as Normal.
+    Background,
+};
+
+// How the hashing code reads files
+struct ReadOptions {
+    ReadMode mode = ReadMode::Normal;
+    // Limit on the bandwidth and operations of all reads that share it, none when null. Every
+    // read of a buffer, every mapped slice and every io_uring read counts as one operation.
+    IoThrottle* throttle = nullptr;
+    // Counter every read adds its bytes to as it goes, none when null. Lets another thread follow
+    // the progress of long reads without waiting for them.
+    std::atomic<uintmax_t>* bytes_read = nullptr;
+    // Token of the scan the reads belong to, none when null. Once it is cancelled every further
+    // read throws ScanCancelled.
+    const CancellationToken* cancel = nullptr;
+};
+
+// Reads of one file through the OS handle, which is what lets the scan ask for O_NOATIME and
+// advise the kernel about the cached pages. Stands in for std::ifstream in the hashing code: a
+// read fills the whole buffer unless it hits the end of the file or an error.
+class FileReader {
+public:
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    FileReader() = default;
+    ~FileReader();
+
+    bool Open(const fs::path& path, const ReadOptions& options = {});
+    [[nodiscard]] bool IsOpen() const noexcept;
+
+    // Bytes read into the buffer, less than size only at the end of the file or on an error,
+    // which HasFailed then tells apart
+    size_t Read(void* buffer, size_t size);
+    // Whether a read since Open failed rather than reached the end of the file
+    [[nodiscard]] bool HasFailed() const noexcept;
+    bool Seek(uint64_t offset);
+    bool GetSize(uint64_t& size);
+    // Announce reads of a few ranges rather than of the whole file. In Background mode the kernel
+    // then reads nothing ahead of them, which could still be in flight when the pages are dropped
+    // and pass for pages that were cached before at the next open.
+    void AdviseRanged();
+
+    // Close the file, dropping its cached pages in Background mode
+    void Close();
+
+private:
+    ReadMode m_mode = ReadMode::Normal;
+    IoThrottle* m_throttle = nullptr;
+    std::atomic<uintmax_t>* m_bytesRead = nullptr;
+    const CancellationToken* m_cancel = nullptr;
+#ifdef _WIN32
+    std::ifstream m_file;
+#else
+    int m_fd = -1;
+    bool m_failed = false;
+    std::vector<unsigned char> m_resident;
+#endif
+};
+
+#ifndef _WIN32
+// Open a file read-only, with O_NOATIME in Background mode where permitted. Returns -1 on failure.
+int open_for_reading(const fs::path& path, ReadMode mode);
+
+// Pages of an open file that are in the page cache, one byte per page as mincore reports them,
+// taken in Background mode before the file is read. Pages a prefetch_file of the file brought in
+// count as not cached. Empty in Normal mode and when residency can't be told.
+std::vector<unsigned char> get_resident_pages(int fd, ReadMode mode);
+
+// Drop the pages of an open file from the page cache in Background mode, except those resident
+// says were cached before the read; all of them when resident is empty. Nothing in Normal mode.
+void release_cached_pages(int fd, ReadMode mode, const std::vector<unsigned char>& resident);
+#endif
+
+// Ask the kernel to start reading the first length bytes of a file into the page cache, so that
+// they are there by the time a worker gets to it. In Background mode the pages that were cached
+// before are noted for get_resident_pages. Does nothing off Linux.
+void prefetch_file(const fs::path& path, uintmax_t length, ReadMode mode);
+
+// Wait for the throttle, if any, to allow a read of `bytes` bytes
+void throttle_read(const ReadOptions& options, uint64_t bytes);
+
+// Give back to the throttle, if any, bytes of a throttled read that were not read
+void refund_read(const ReadOptions& options, uint64_t bytes);
+
+// Add bytes that were read to the counter of the options, if any
+void count_read(const ReadOptions& options, uint64_t bytes);
+
+// Throw ScanCancelled once the token of the options, if any, is cancelled
+void check_cancelled(const ReadOptions& options);
@@ -0,0 +1,39 @@
+#include "file_sync.h"
+
+#include <system_error>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+void sync_file(const fs::path& path) {
+#ifdef _WIN32
+    HANDLE file = ::CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::system_error(static_cast<int>(::GetLastError()), std::system_category(), "Failed to open file: " + path.string());
+    }
+    const bool ok = ::FlushFileBuffers(file);
+    const DWORD error = ::GetLastError();
+    ::CloseHandle(file);
+    if (!ok) {
+        throw std::system_error(static_cast<int>(error), std::system_category(), "Failed to sync file: " + path.string());
+    }
+#else
+    // fsync writes back the dirty pages of the file whichever descriptor wrote them
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Failed to open file: " + path.string());
+    }
+    const int result = ::fsync(fd);
+    const int error = errno;
+    ::close(fd);
+    if (result != 0) {
+        throw std::system_error(error, std::generic_category(), "Failed to sync file: " + path.string());
+    }
+#endif
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Flush a written file to the disk, so that a rename of it over an older version never leaves
+// the name pointing at data that isn't there yet after a power loss. Throws std::system_error.
+void sync_file(const fs::path& path);
@@ -0,0 +1,217 @@
+#include "hash_cache.h"
+#include "file_sync.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// File layout: magic, format version and file count, then per file its identity, the number of
+// digests and the digests, all in host byte order. The cache describes files of this machine
+// only, so it is never moved between hosts.
+constexpr char cache_magic[4] = { 'D', 'F', 'H', 'C' };
+constexpr uint32_t cache_version = 1;
+constexpr size_t identity_record_size = 5 * sizeof(uint64_t) + 1;
+constexpr size_t digest_record_size = 2 + 2 * sizeof(uint64_t) + 1 + Digest::max_size;
+
+template<typename T>
+void put(std::vector<unsigned char>& out, T value) {
+    const size_t offset = out.size();
+    out.resize(offset + sizeof(value));
+    std::memcpy(out.data() + offset, &value, sizeof(value));
+}
+
+template<typename T>
+T get(const unsigned char*& in) {
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return value;
+}
+
+} // namespace
+
+void HashCache::Load(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::error_code ec;
+        if (!fs::exists(path, ec)) {
+            return;
+        }
+        throw std::runtime_error("Failed to open hash cache: " + path.string());
+    }
+
+    char magic[sizeof(cache_magic)];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!file || std::memcmp(magic, cache_magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a hash cache: " + path.string());
+    }
+    if (version != cache_version) {
+        throw std::runtime_error("Unsupported hash cache version " + std::to_string(version) + ": " + path.string());
+    }
+
+    const auto truncated = [&] {
+        return std::runtime_error("Truncated hash cache: " + path.string());
+    };
+
+    std::unordered_map<FileKey, Entry, FileKeyHash> entries;
+    entries.reserve(static_cast<size_t>(count));
+    unsigned char record[std::max(identity_record_size, digest_record_size)];
+    for (uint64_t i = 0; i < count; ++i) {
+        if (!file.read(reinterpret_cast<char*>(record), identity_record_size)) {
+            throw truncated();
+        }
+
+        const unsigned char* in = record;
+        FileIdentity identity;
+        identity.device = get<uint64_t>(in);
+        identity.inode = get<uint64_t>(in);
+        identity.size = get<uint64_t>(in);
+        identity.mtime_ns = get<int64_t>(in);
+        identity.ctime_ns = get<int64_t>(in);
+        const uint8_t digest_count = get<uint8_t>(in);
+
+        Entry& entry = entries[{ identity.device, identity.inode }];
+        entry.identity = identity;
+        entry.digests.clear();
+
+        for (uint8_t j = 0; j < digest_count; ++j) {
+            if (!file.read(reinterpret_cast<char*>(record), digest_record_size)) {
+                throw truncated();
+            }
+
+            in = record;
+            CachedHashKey key;
+            Digest digest;
+            key.kind = static_cast<CachedHashKey::Kind>(get<uint8_t>(in));
+            key.algorithm = static_cast<HashAlgorithm>(get<uint8_t>(in));
+            key.first_block = get<uint64_t>(in);
+            key.second_block = get<uint64_t>(in);
+            digest.algorithm = key.algorithm;
+            digest.size = get<uint8_t>(in);
+            std::memcpy(digest.bytes.data(), in, Digest::max_size);
+            if (digest.size > Digest::max_size) {
+                throw std::runtime_error("Corrupt hash cache: " + path.string());
+            }
+            entry.digests.emplace_back(key, digest);
+        }
+    }
+
+    std::unique_lock lock(m_mutex);
+    m_entries = std::move(entries);
+}
+
+void HashCache::Save(const fs::path& path) const {
+    if (path.has_parent_path()) {
+        fs::create_directories(path.parent_path());
+    }
+
+    std::vector<unsigned char> data;
+    {
+        std::shared_lock lock(m_mutex);
+        data.reserve(sizeof(cache_magic) + sizeof(uint32_t) + sizeof(uint64_t)
+            + m_entries.size() * (identity_record_size + digest_record_size));
+        data.insert(data.end(), cache_magic, cache_magic + sizeof(cache_magic));
+        put<uint32_t>(data, cache_version);
+        put<uint64_t>(data, m_entries.size());
+
+        for (const auto& [fileKey, entry] : m_entries) {
+            put<uint64_t>(data, entry.identity.device);
+            put<uint64_t>(data, entry.identity.inode);
+            put<uint64_t>(data, entry.identity.size);
+            put<int64_t>(data, entry.identity.mtime_ns);
+            put<int64_t>(data, entry.identity.ctime_ns);
+            put<uint8_t>(data, static_cast<uint8_t>(entry.digests.size()));
+
+            for (const auto& [key, digest] : entry.digests) {
+                put<uint8_t>(data, static_cast<uint8_t>(key.kind));
+                put<uint8_t>(data, static_cast<uint8_t>(key.algorithm));
+                put<uint64_t>(data, key.first_block);
+                put<uint64_t>(data, key.second_block);
+                put<uint8_t>(data, digest.size);
+                data.insert(data.end(), digest.bytes.begin(), digest.bytes.end());
+            }
+        }
+    }
+
+    fs::path temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to create hash cache: " + temp_path.string());
+        }
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!file.flush()) {
+            throw std::runtime_error("Failed to write hash cache: " + temp_path.string());
+        }
+    }
+
+    sync_file(temp_path);
+    fs::rename(temp_path, path);
+}
+
+void HashCache::Prune() {
+    std::unique_lock lock(m_mutex);
+    std::erase_if(m_entries, [](const auto& item) {
+        return !item.second.seen.load(std::memory_order_relaxed);
+    });
+}
+
+std::optional<Digest> HashCache::Lookup(const FileIdentity& identity, const CachedHashKey& key) const {
+    std::shared_lock lock(m_mutex);
+    auto it = m_entries.find({ identity.device, identity.inode });
+    if (it == m_entries.end() || it->second.identity != identity) {
+        return std::nullopt;
+    }
+    it->second.seen.store(true, std::memory_order_relaxed);
+
+    for (const auto& [cachedKey, digest] : it->second.digests) {
+        if (cachedKey == key) {
+            return digest;
+        }
+    }
+    return std::nullopt;
+}
+
+void HashCache::Touch(const FileIdentity& identity) const {
+    std::shared_lock lock(m_mutex);
+    auto it = m_entries.find({ identity.device, identity.inode });
+    if (it != m_entries.end() && it->second.identity == identity) {
+        it->second.seen.store(true, std::memory_order_relaxed);
+    }
+}
+
+void HashCache::Store(const FileIdentity& identity, const CachedHashKey& key, const Digest& digest) {
+    std::unique_lock lock(m_mutex);
+    Entry& entry = m_entries[{ identity.device, identity.inode }];
+    entry.seen.store(true, std::memory_order_relaxed);
+    if (entry.identity != identity) {
+        // The file changed since its digests were stored
+        entry.identity = identity;
+        entry.digests.clear();
+    }
+
+    auto it = std::find_if(entry.digests.begin(), entry.digests.end(), [&](const auto& cached) {
+        return cached.first.kind == key.kind;
+    });
+    if (it != entry.digests.end()) {
+        *it = { key, digest };
+    }
+    else {
+        entry.digests.emplace_back(key, digest);
+    }
+}
+
+size_t HashCache::GetSize() const {
+    std::shared_lock lock(m_mutex);
+    return m_entries.size();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "digest.h"
+#include "file_identity.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Which digest of a file a cache entry holds. Partial digests also record the block sizes they
+// were computed with, so changing the scan options never serves a digest of other ranges.
+struct CachedHashKey {
+    enum class Kind : uint8_t {
+        HeadTail,
+        Middle,
+        Full,
+    };
+
+    Kind kind = Kind::Full;
+    HashAlgorithm algorithm = HashAlgorithm::Sha256;
+    // Head and tail block for HeadTail, the middle block for Middle, unused for Full
+    uint64_t first_block = 0;
+    uint64_t second_block = 0;
+
+    bool operator==(const CachedHashKey& other) const = default;
+};
+
+// Persistent map from file identity to the digests the scan computed for it, so files that
+// haven't changed since the last scan are never read again. Entries are keyed by device and
+// inode; once the size, mtime or ctime of a file differ from the stored ones its digests are
+// stale and miss, and the next Store replaces them. Entries a scan never touched can be dropped
+// with Prune, so the files that are gone don't pile up from scan to scan.
+// Lookup and Store may be called from any thread.
+class HashCache {
+public:
+    HashCache() = default;
+    HashCache(const HashCache&) = delete;
+    HashCache& operator=(const HashCache&) = delete;
+
+    // Load the cache file. A missing file leaves the cache empty; a file that can't be read or
+    // has another format version throws std::runtime_error.
+    void Load(const fs::path& path);
+
+    // Write the cache to a temporary file, sync it to disk and rename it over path, so neither a
+    // crash nor a power loss leaves a truncated cache behind
+    void Save(const fs::path& path) const;
+
+    // Drop the entries of every file no Lookup or Store has seen since Load. Meant for after a
+    // complete scan, which looks up every file that could still need a digest.
+    void Prune();
+
+    std::optional<Digest> Lookup(const FileIdentity& identity, const CachedHashKey& key) const;
+    // Count the file as seen for Prune without looking up a digest, for a file whose digests come
+    // from elsewhere, such as a scan checkpoint
+    void Touch(const FileIdentity& identity) const;
+    void Store(const FileIdentity& identity, const CachedHashKey& key, const Digest& digest);
+
+    // Number of files with at least one digest
+    [[nodiscard]] size_t GetSize() const;
+
+private:
+    struct FileKey {
+        uint64_t device;
+        uint64_t inode;
+
+        bool operator==(const FileKey& other) const = default;
+    };
+
+    struct FileKeyHash {
+        size_t operator()(const FileKey& key) const noexcept {
+            return static_cast<size_t>(key.inode * 0x9e3779b97f4a7c15ull ^ key.device);
+        }
+    };
+
+    struct Entry {
+        FileIdentity identity;
+        // At most one digest per kind
+        std::vector<std::pair<CachedHashKey, Digest>> digests;
+        // Set by Lookup under the shared lock, hence atomic; entries are therefore never moved
+        mutable std::atomic<bool> seen{ false };
+    };
+
+    std::unordered_map<FileKey, Entry, FileKeyHash> m_entries;
+    mutable std::shared_mutex m_mutex;
+};
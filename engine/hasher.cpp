@@ -0,0 +1,253 @@
+#include "hasher.h"
+
+#include <openssl/sha.h>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#ifdef DUPFINDER_HAVE_BLAKE3
+#include <blake3.h>
+#endif
+
+#ifdef DUPFINDER_HAVE_XXHASH
+#include <xxhash.h>
+#endif
+
+namespace {
+
+class Sha256Hasher : public Hasher {
+public:
+    Sha256Hasher() {
+        SHA256_Init(&m_ctx);
+    }
+
+    void Update(const void* data, size_t size) override {
+        SHA256_Update(&m_ctx, data, size);
+    }
+
+    Digest Final() override {
+        static_assert(SHA256_DIGEST_LENGTH <= Digest::max_size);
+        Digest digest;
+        digest.algorithm = HashAlgorithm::Sha256;
+        digest.size = SHA256_DIGEST_LENGTH;
+        SHA256_Final(digest.bytes.data(), &m_ctx);
+        SHA256_Init(&m_ctx);
+        return digest;
+    }
+
+    HashAlgorithm GetAlgorithm() const noexcept override {
+        return HashAlgorithm::Sha256;
+    }
+
+    std::unique_ptr<Hasher> Clone() const override {
+        return std::make_unique<Sha256Hasher>(*this);
+    }
+
+private:
+    SHA256_CTX m_ctx;
+};
+
+class Sha1Hasher : public Hasher {
+public:
+    Sha1Hasher() {
+        SHA1_Init(&m_ctx);
+    }
+
+    void Update(const void* data, size_t size) override {
+        SHA1_Update(&m_ctx, data, size);
+    }
+
+    Digest Final() override {
+        static_assert(SHA_DIGEST_LENGTH <= Digest::max_size);
+        Digest digest;
+        digest.algorithm = HashAlgorithm::Sha1;
+        digest.size = SHA_DIGEST_LENGTH;
+        SHA1_Final(digest.bytes.data(), &m_ctx);
+        SHA1_Init(&m_ctx);
+        return digest;
+    }
+
+    HashAlgorithm GetAlgorithm() const noexcept override {
+        return HashAlgorithm::Sha1;
+    }
+
+    std::unique_ptr<Hasher> Clone() const override {
+        return std::make_unique<Sha1Hasher>(*this);
+    }
+
+private:
+    SHA_CTX m_ctx;
+};
+
+#ifdef DUPFINDER_HAVE_BLAKE3
+class Blake3Hasher : public Hasher {
+public:
+    Blake3Hasher() {
+        blake3_hasher_init(&m_hasher);
+    }
+
+    void Update(const void* data, size_t size) override {
+        blake3_hasher_update(&m_hasher, data, size);
+    }
+
+    Digest Final() override {
+        static_assert(BLAKE3_OUT_LEN <= Digest::max_size);
+        Digest digest;
+        digest.algorithm = HashAlgorithm::Blake3;
+        digest.size = BLAKE3_OUT_LEN;
+        blake3_hasher_finalize(&m_hasher, digest.bytes.data(), BLAKE3_OUT_LEN);
+        blake3_hasher_init(&m_hasher);
+        return digest;
+    }
+
+    HashAlgorithm GetAlgorithm() const noexcept override {
+        return HashAlgorithm::Blake3;
+    }
+
+    std::unique_ptr<Hasher> Clone() const override {
+        return std::make_unique<Blake3Hasher>(*this);
+    }
+
+private:
+    blake3_hasher m_hasher;
+};
+#endif
+
+#ifdef DUPFINDER_HAVE_XXHASH
+class Xxh3Hasher : public Hasher {
+public:
+    Xxh3Hasher() : m_state(XXH3_createState()) {
+        if (!m_state) {
+            throw std::bad_alloc();
+        }
+        XXH3_128bits_reset(m_state);
+    }
+
+    ~Xxh3Hasher() override {
+        XXH3_freeState(m_state);
+    }
+
+    Xxh3Hasher(const Xxh3Hasher&) = delete;
+    Xxh3Hasher& operator=(const Xxh3Hasher&) = delete;
+
+    void Update(const void* data, size_t size) override {
+        XXH3_128bits_update(m_state, data, size);
+    }
+
+    Digest Final() override {
+        XXH128_canonical_t canonical;
+        XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(m_state));
+        XXH3_128bits_reset(m_state);
+
+        static_assert(sizeof(canonical.digest) <= Digest::max_size);
+        Digest digest;
+        digest.algorithm = HashAlgorithm::Xxh3_128;
+        digest.size = sizeof(canonical.digest);
+        std::memcpy(digest.bytes.data(), canonical.digest, sizeof(canonical.digest));
+        return digest;
+    }
+
+    HashAlgorithm GetAlgorithm() const noexcept override {
+        return HashAlgorithm::Xxh3_128;
+    }
+
+    std::unique_ptr<Hasher> Clone() const override {
+        auto clone = std::make_unique<Xxh3Hasher>();
+        XXH3_copyState(clone->m_state, m_state);
+        return clone;
+    }
+
+private:
+    XXH3_state_t* m_state;
+};
+#endif
+
+} // namespace
+
+std::unique_ptr<Hasher> create_hasher(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::Sha256:
+        return std::make_unique<Sha256Hasher>();
+    case HashAlgorithm::Sha1:
+        return std::make_unique<Sha1Hasher>();
+#ifdef DUPFINDER_HAVE_BLAKE3
+    case HashAlgorithm::Blake3:
+        return std::make_unique<Blake3Hasher>();
+#endif
+#ifdef DUPFINDER_HAVE_XXHASH
+    case HashAlgorithm::Xxh3_128:
+        return std::make_unique<Xxh3Hasher>();
+#endif
+    default:
+        throw std::invalid_argument(std::string("Hash algorithm not available in this build: ") + hash_algorithm_name(algorithm));
+    }
+}
+
+bool is_hash_algorithm_available(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::Sha256:
+    case HashAlgorithm::Sha1:
+        return true;
+    case HashAlgorithm::Blake3:
+#ifdef DUPFINDER_HAVE_BLAKE3
+        return true;
+#else
+        return false;
+#endif
+    case HashAlgorithm::Xxh3_128:
+#ifdef DUPFINDER_HAVE_XXHASH
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const std::vector<HashAlgorithm>& hash_algorithms() {
+    static const std::vector<HashAlgorithm> algorithms = {
+        HashAlgorithm::Sha256,
+        HashAlgorithm::Sha1,
+        HashAlgorithm::Blake3,
+        HashAlgorithm::Xxh3_128,
+    };
+    return algorithms;
+}
+
+const char* hash_algorithm_name(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::Sha256:
+        return "sha256";
+    case HashAlgorithm::Sha1:
+        return "sha1";
+    case HashAlgorithm::Blake3:
+        return "blake3";
+    case HashAlgorithm::Xxh3_128:
+        return "xxh3-128";
+    }
+    return "unknown";
+}
+
+std::optional<HashAlgorithm> parse_hash_algorithm(std::string_view name) {
+    for (HashAlgorithm algorithm : hash_algorithms()) {
+        if (name == hash_algorithm_name(algorithm)) {
+            return algorithm;
+        }
+    }
+    return std::nullopt;
+}
+
+size_t hash_algorithm_digest_size(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::Sha256:
+        return SHA256_DIGEST_LENGTH;
+    case HashAlgorithm::Sha1:
+        return SHA_DIGEST_LENGTH;
+    case HashAlgorithm::Blake3:
+        return 32;
+    case HashAlgorithm::Xxh3_128:
+        return 16;
+    }
+    return Digest::max_size;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "digest.h"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Incremental content hasher. One instance hashes one stream at a time: Update() any number
+// of times, then Final() returns the digest and resets the hasher for the next stream.
+class Hasher {
+public:
+    virtual ~Hasher() = default;
+
+    virtual void Update(const void* data, size_t size) = 0;
+    virtual Digest Final() = 0;
+
+    // New hasher in the same state, so that two streams sharing a prefix hash it only once
+    [[nodiscard]] virtual std::unique_ptr<Hasher> Clone() const = 0;
+
+    [[nodiscard]] virtual HashAlgorithm GetAlgorithm() const noexcept = 0;
+};
+
+// Create a hasher for the algorithm. Throws std::invalid_argument when the engine was built
+// without it.
+std::unique_ptr<Hasher> create_hasher(HashAlgorithm algorithm);
+
+// Whether the engine was built with the algorithm. SHA-256 and SHA-1 always are, BLAKE3 and
+// XXH3 depend on the libraries found at configure time.
+bool is_hash_algorithm_available(HashAlgorithm algorithm);
+
+// Every algorithm, available or not
+const std::vector<HashAlgorithm>& hash_algorithms();
+
+const char* hash_algorithm_name(HashAlgorithm algorithm);
+std::optional<HashAlgorithm> parse_hash_algorithm(std::string_view name);
+
+// Length of the digest the algorithm produces, in bytes
+size_t hash_algorithm_digest_size(HashAlgorithm algorithm);
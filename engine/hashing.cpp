@@ -0,0 +1,219 @@
+#include "hashing.h"
+#include "file_reader.h"
+#include "mapped_file.h"
+#include "sha256_batch.h"
+#include "sparse_file.h"
+#include "text.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+std::wstring hash_to_wstring(const unsigned char* hash, size_t length) {
+    std::wstringstream result;
+    for (size_t i = 0; i < length; ++i) {
+        result << std::setw(2) << std::setfill(L'0') << std::hex << static_cast<int>(hash[i]);
+    }
+    return result.str();
+}
+
+std::wstring hash_to_wstring(const Digest& digest) {
+    return hash_to_wstring(digest.bytes.data(), digest.size);
+}
+
+std::string hash_to_string(const Digest& digest) {
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(digest.size * 2);
+    for (size_t i = 0; i < digest.size; ++i) {
+        result.push_back(hex[digest.bytes[i] >> 4]);
+        result.push_back(hex[digest.bytes[i] & 0x0f]);
+    }
+    return result;
+}
+
+namespace {
+
+// Zeros standing in for the holes of sparse files
+constexpr size_t zero_block_size = 64 * 1024;
+const unsigned char zero_block[zero_block_size] = {};
+
+void hash_zeros(Hasher& hasher, uintmax_t length) {
+    while (length > 0) {
+        const size_t chunk = static_cast<size_t>(std::min<uintmax_t>(length, zero_block_size));
+        hasher.Update(zero_block, chunk);
+        length -= chunk;
+    }
+}
+
+// Hash a file with holes by reading only its data segments and hashing every hole as the zeros it
+// reads as, so the digest equals that of a dense copy. Returns false without hashing anything
+// when the segments can't be listed.
+bool hash_sparse_file(const fs::path& file_path, uintmax_t size, Hasher& hasher, const ReadOptions& read_options) {
+    std::vector<FileRange> segments;
+    if (!get_data_segments(file_path, segments)) {
+        return false;
+    }
+
+    FileReader file;
+    if (!file.Open(file_path, read_options)) {
+        throw std::runtime_error("Failed to open file: " + file_path.string());
+    }
+
+    std::vector<char> buffer(zero_block_size);
+    uintmax_t position = 0;
+    for (auto [offset, length] : segments) {
+        if (offset >= size) {
+            break;
+        }
+        length = std::min(length, size - offset);
+        hash_zeros(hasher, offset - position);
+
+        file.Seek(offset);
+        for (uintmax_t remaining = length; remaining > 0;) {
+            const size_t count = file.Read(buffer.data(), static_cast<size_t>(std::min<uintmax_t>(buffer.size(), remaining)));
+            if (count == 0) {
+                throw std::runtime_error("Failed to read file: " + file_path.string());
+            }
+            hasher.Update(buffer.data(), count);
+            remaining -= count;
+        }
+        position = offset + length;
+    }
+    hash_zeros(hasher, size - position);
+    return true;
+}
+
+} // namespace
+
+Digest compute_file_hash(const fs::path& file_path, HashAlgorithm algorithm, uintmax_t mmap_threshold, const ReadOptions& read_options) {
+    auto hasher = create_hasher(algorithm);
+
+    // Holes are neither read nor mapped; only the data segments of a sparse file are read
+    if (is_sparse_file(file_path)) {
+        std::error_code ec;
+        const uintmax_t size = fs::file_size(file_path, ec);
+        if (!ec && hash_sparse_file(file_path, size, *hasher, read_options)) {
+            return hasher->Final();
+        }
+    }
+
+    // Large regular files are hashed straight from the mapped page cache, which saves a read
+    // call and a copy per buffer. Special files and files that can't be mapped use the stream.
+    std::error_code ec;
+    const uintmax_t size = mmap_threshold > 0 ? fs::file_size(file_path, ec) : 0;
+    if (mmap_threshold > 0 && !ec && size >= mmap_threshold
+        && read_mapped_file(file_path, [&](const unsigned char* data, size_t length) { hasher->Update(data, length); }, read_options)) {
+        return hasher->Final();
+    }
+
+    FileReader file;
+    if (!file.Open(file_path, read_options)) {
+        throw std::runtime_error("Failed to open file: " + file_path.string());
+    }
+
+    constexpr size_t buffer_size = 8192;
+    char buffer[buffer_size];
+    size_t count;
+    while ((count = file.Read(buffer, buffer_size)) == buffer_size) {
+        hasher->Update(buffer, count);
+    }
+    // A failed read would otherwise pass for the end of the file and yield the digest of a prefix
+    if (file.HasFailed()) {
+        throw std::runtime_error("Failed to read file: " + file_path.string());
+    }
+    // Update for any remaining bytes
+    hasher->Update(buffer, count);
+    return hasher->Final();
+}
+
+Digest compute_partial_hash(const fs::path& file_path, const std::vector<FileRange>& ranges, uintmax_t& bytes_read, HashAlgorithm algorithm,
+    const ReadOptions& read_options) {
+    FileReader file;
+    if (!file.Open(file_path, read_options)) {
+        throw std::runtime_error("Failed to open file: " + file_path.string());
+    }
+    file.AdviseRanged();
+
+    auto hasher = create_hasher(algorithm);
+
+    constexpr size_t buffer_size = 8192;
+    char buffer[buffer_size];
+    for (const auto& [offset, length] : ranges) {
+        file.Seek(offset);
+        uintmax_t remaining = length;
+        while (remaining > 0) {
+            const size_t count = file.Read(buffer, static_cast<size_t>(std::min<uintmax_t>(buffer_size, remaining)));
+            if (count == 0) {
+                throw std::runtime_error("Failed to read file: " + file_path.string());
+            }
+            hasher->Update(buffer, count);
+            bytes_read += count;
+            remaining -= count;
+        }
+    }
+
+    return hasher->Final();
+}
+
+std::vector<FileHashResult> compute_file_hashes(const std::vector<fs::path>& file_paths, HashAlgorithm algorithm, const ReadOptions& read_options) {
+    std::vector<FileHashResult> results(file_paths.size());
+
+    if (algorithm != HashAlgorithm::Sha256) {
+        for (size_t i = 0; i < file_paths.size(); ++i) {
+            try {
+                results[i].hash = compute_file_hash(file_paths[i], algorithm, default_mmap_threshold, read_options);
+                std::error_code ec;
+                results[i].bytes_read = fs::file_size(file_paths[i], ec);
+            }
+            catch (const std::exception& e) {
+                results[i].error = e.what();
+            }
+        }
+        return results;
+    }
+
+    // Read the files one after the other into a shared buffer, then hash the contents together.
+    // Every file is read with a single call straight into the buffer.
+    std::vector<unsigned char> contents;
+    std::vector<std::pair<size_t, size_t>> ranges;
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < file_paths.size(); ++i) {
+        FileReader file;
+        if (!file.Open(file_paths[i], read_options)) {
+            results[i].error = "Failed to open file: " + file_paths[i].string();
+            continue;
+        }
+
+        uint64_t end = 0;
+        const bool sized = file.GetSize(end);
+        const size_t offset = contents.size();
+        const size_t size = static_cast<size_t>(end);
+        contents.resize(offset + size);
+        if (!sized || file.Read(contents.data() + offset, size) != size) {
+            contents.resize(offset);
+            results[i].error = "Failed to read file: " + file_paths[i].string();
+            continue;
+        }
+
+        results[i].bytes_read = size;
+        ranges.emplace_back(offset, size);
+        indices.push_back(i);
+    }
+
+    std::vector<const unsigned char*> messages;
+    std::vector<size_t> sizes;
+    for (const auto& [offset, size] : ranges) {
+        messages.push_back(contents.data() + offset);
+        sizes.push_back(size);
+    }
+
+    std::vector<Digest> digests(messages.size());
+    sha256_batch(messages.data(), sizes.data(), messages.size(), digests.data());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        results[indices[i]].hash = digests[i];
+    }
+
+    return results;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "digest.h"
+#include "file_reader.h"
+#include "hasher.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using LogCallback = std::function<void(std::wstring)>;
+
+// A byte range of a file: offset and length
+using FileRange = std::pair<uintmax_t, uintmax_t>;
+
+// Format a binary digest as a lowercase hex string
+std::wstring hash_to_wstring(const unsigned char* hash, size_t length);
+std::wstring hash_to_wstring(const Digest& digest);
+std::string hash_to_string(const Digest& digest);
+
+// Regular files at least this large are hashed from memory-mapped windows instead of stream
+// reads. dupfinder-bench mmap puts the crossover around 256 KiB on a warm cache; the default
+// leaves room for the page fault cost of cold files.
+constexpr uintmax_t default_mmap_threshold = 1024 * 1024;
+
+// Compute hash of a file, SHA-256 unless another algorithm is given. Files of mmap_threshold bytes
+// or more are mapped; 0 always uses the stream.
+Digest compute_file_hash(const fs::path& file_path, HashAlgorithm algorithm = HashAlgorithm::Sha256, uintmax_t mmap_threshold = default_mmap_threshold, const ReadOptions& read_options = {});
+
+// Compute hash of the selected ranges of a file. Ranges are hashed in the given order, so
+// contiguous ranges covering the whole file produce the same hash as compute_file_hash.
+Digest compute_partial_hash(const fs::path& file_path, const std::vector<FileRange>& ranges, uintmax_t& bytes_read, HashAlgorithm algorithm = HashAlgorithm::Sha256,
+    const ReadOptions& read_options = {});
+
+// Outcome of one file of compute_file_hashes. error is set instead of hash when the file could
+// not be read.
+struct FileHashResult {
+    Digest hash;
+    uintmax_t bytes_read = 0;
+    std::string error;
+};
+
+// Compute full hashes of a batch of small files. SHA-256 batches are read into memory and hashed
+// side by side by sha256_batch; other algorithms hash the files one after the other.
+std::vector<FileHashResult> compute_file_hashes(const std::vector<fs::path>& file_paths, HashAlgorithm algorithm = HashAlgorithm::Sha256,
+    const ReadOptions& read_options = {});
@@ -0,0 +1,170 @@
+#include "io_pressure.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+bool read_io_pressure(const fs::path& path, IoPressure& pressure) {
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string kind;
+        fields >> kind;
+        if (kind != "some") {
+            continue;
+        }
+
+        bool complete = false;
+        std::string field;
+        while (fields >> field) {
+            const size_t equals = field.find('=');
+            if (equals == std::string::npos) {
+                return false;
+            }
+            const std::string name = field.substr(0, equals);
+            const std::string value = field.substr(equals + 1);
+            try {
+                if (name == "avg10") {
+                    pressure.avg10 = std::stod(value);
+                }
+                else if (name == "avg60") {
+                    pressure.avg60 = std::stod(value);
+                }
+                else if (name == "avg300") {
+                    pressure.avg300 = std::stod(value);
+                }
+                else if (name == "total") {
+                    pressure.total_us = std::stoull(value);
+                    complete = true;
+                }
+            }
+            catch (const std::exception&) {
+                return false;
+            }
+        }
+        return complete;
+    }
+    return false;
+}
+
+fs::path default_io_pressure_file() {
+    IoPressure pressure;
+
+    // The cgroup v2 entry is the line with hierarchy ID 0, e.g. "0::/system.slice/backup.service"
+    std::ifstream cgroups("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroups, line)) {
+        if (line.rfind("0::", 0) != 0) {
+            continue;
+        }
+        const fs::path group = fs::path(line.substr(3)).relative_path();
+        for (const char* mount : { "/sys/fs/cgroup", "/sys/fs/cgroup/unified" }) {
+            const fs::path candidate = fs::path(mount) / group / "io.pressure";
+            if (read_io_pressure(candidate, pressure)) {
+                return candidate;
+            }
+        }
+    }
+
+    const fs::path system = "/proc/pressure/io";
+    if (read_io_pressure(system, pressure)) {
+        return system;
+    }
+    return {};
+}
+
+PressureController::PressureController(fs::path pressureFile, double ceiling, unsigned maxLimit, LimitCallback callback,
+    std::chrono::milliseconds interval)
+    : m_pressureFile(std::move(pressureFile)), m_ceiling(ceiling), m_maxLimit(std::max(maxLimit, 1u)), m_callback(std::move(callback)),
+    m_interval(interval), m_limit(m_maxLimit), m_lowestLimit(m_maxLimit) {
+    m_callback(m_limit);
+    m_thread = std::thread(&PressureController::Poll, this);
+}
+
+PressureController::~PressureController() {
+    Stop();
+}
+
+void PressureController::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_stopRequested.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+unsigned PressureController::GetLimit() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limit;
+}
+
+unsigned PressureController::GetLowestLimit() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lowestLimit;
+}
+
+uint64_t PressureController::GetChanges() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_changes;
+}
+
+double PressureController::GetLastPressure() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastPressure;
+}
+
+void PressureController::Poll() {
+    using Clock = std::chrono::steady_clock;
+
+    IoPressure last;
+    bool valid = read_io_pressure(m_pressureFile, last);
+    Clock::time_point lastTime = Clock::now();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopRequested.wait_for(lock, m_interval, [this] { return m_stopping; })) {
+        lock.unlock();
+        IoPressure current;
+        const bool read = read_io_pressure(m_pressureFile, current);
+        const Clock::time_point now = Clock::now();
+        lock.lock();
+
+        if (!read) {
+            valid = false;
+            continue;
+        }
+        if (!valid) {
+            last = current;
+            lastTime = now;
+            valid = true;
+            continue;
+        }
+
+        const double elapsed_us = std::chrono::duration<double, std::micro>(now - lastTime).count();
+        const double stalled_us = static_cast<double>(current.total_us - std::min(current.total_us, last.total_us));
+        m_lastPressure = elapsed_us > 0 ? std::min(100.0, stalled_us / elapsed_us * 100) : 0;
+        last = current;
+        lastTime = now;
+
+        unsigned limit = m_limit;
+        if (m_lastPressure > m_ceiling) {
+            limit = std::max(1u, limit / 2);
+        }
+        else if (m_lastPressure < m_ceiling / 2) {
+            limit = std::min(m_maxLimit, limit + 1);
+        }
+        if (limit == m_limit) {
+            continue;
+        }
+
+        m_limit = limit;
+        m_lowestLimit = std::min(m_lowestLimit, limit);
+        ++m_changes;
+        // The callback runs under the mutex, so Stop can't return while it is running
+        m_callback(limit);
+    }
+}
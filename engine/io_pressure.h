@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+// Linux pressure stall information of a pressure file's "some" line: the share of time in which
+// at least one task waited for I/O
+struct IoPressure {
+    // Percentages averaged over the last 10, 60 and 300 seconds
+    double avg10 = 0;
+    double avg60 = 0;
+    double avg300 = 0;
+    // Microseconds stalled since boot, which gives the pressure over any interval
+    uint64_t total_us = 0;
+};
+
+// Read the "some" line of a pressure file. Returns false when the file is missing or malformed,
+// which includes kernels without PSI and every platform other than Linux.
+bool read_io_pressure(const fs::path& path, IoPressure& pressure);
+
+// The pressure file that covers this process: io.pressure of its cgroup v2 group where the
+// group has one, the system-wide /proc/pressure/io otherwise. Empty when neither is readable.
+fs::path default_io_pressure_file();
+
+// Keeps the I/O pressure under a ceiling by adjusting a concurrency limit between 1 and a
+// maximum. A thread polls the pressure file and computes the stall share of every interval from
+// the stall totals: above the ceiling the limit is halved, below half the ceiling it grows by
+// one, in between it stays. The limit is handed to the callback whenever it changes, on the
+// polling thread.
+class PressureController {
+public:
+    PressureController(const PressureController&) = delete;
+    PressureController& operator=(const PressureController&) = delete;
+
+    using LimitCallback = std::function<void(unsigned limit)>;
+
+    // Starts polling at once; the callback first gets the maximum
+    PressureController(fs::path pressureFile, double ceiling, unsigned maxLimit, LimitCallback callback,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(500));
+    ~PressureController();
+
+    // Stop polling; the callback isn't called again once this returns
+    void Stop();
+
+    [[nodiscard]] unsigned GetLimit() const;
+    [[nodiscard]] unsigned GetLowestLimit() const;
+    [[nodiscard]] uint64_t GetChanges() const;
+    // Stall share of the last interval, in percent
+    [[nodiscard]] double GetLastPressure() const;
+
+private:
+    void Poll();
+
+    fs::path m_pressureFile;
+    double m_ceiling;
+    unsigned m_maxLimit;
+    LimitCallback m_callback;
+    std::chrono::milliseconds m_interval;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stopRequested;
+    bool m_stopping = false;
+    unsigned m_limit;
+    unsigned m_lowestLimit;
+    uint64_t m_changes = 0;
+    double m_lastPressure = 0;
+    std::thread m_thread;
+};
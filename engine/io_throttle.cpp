@@ -0,0 +1,108 @@
+#include "io_throttle.h"
+
+#include <algorithm>
+
+namespace {
+
+// Longest idle time whose unused capacity can be spent in a burst afterwards
+constexpr double burst_seconds = 0.1;
+
+} // namespace
+
+IoThrottle::IoThrottle(uint64_t bytesPerSecond, uint64_t operationsPerSecond)
+    : m_bytesPerSecond(bytesPerSecond), m_operationsPerSecond(operationsPerSecond), m_lastRefill(Clock::now()) {
+}
+
+void IoThrottle::SetLimits(uint64_t bytesPerSecond, uint64_t operationsPerSecond) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Refill(Clock::now());
+        m_bytesPerSecond = bytesPerSecond;
+        m_operationsPerSecond = operationsPerSecond;
+        // Debt run up under the old limits is forgiven, so a raised limit applies at once
+        m_byteTokens = std::max(m_byteTokens, 0.0);
+        m_operationTokens = std::max(m_operationTokens, 0.0);
+        ++m_generation;
+    }
+    m_limitsChanged.notify_all();
+}
+
+uint64_t IoThrottle::GetBytesPerSecond() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytesPerSecond;
+}
+
+uint64_t IoThrottle::GetOperationsPerSecond() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_operationsPerSecond;
+}
+
+void IoThrottle::Acquire(uint64_t bytes) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_bytesAcquired += bytes;
+    ++m_operationsAcquired;
+    if (m_bytesPerSecond == 0 && m_operationsPerSecond == 0) {
+        return;
+    }
+
+    Refill(Clock::now());
+    if (m_bytesPerSecond > 0) {
+        m_byteTokens -= static_cast<double>(bytes);
+    }
+    if (m_operationsPerSecond > 0) {
+        m_operationTokens -= 1;
+    }
+
+    // Sleep until the debt this read leaves, including that of the readers ahead of it, is paid
+    // off. A change of limits ends the wait early.
+    const double debt = Debt();
+    if (debt > 0) {
+        const uint64_t generation = m_generation;
+        const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(debt));
+        m_limitsChanged.wait_until(lock, deadline, [&] { return m_generation != generation; });
+    }
+}
+
+void IoThrottle::Refund(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bytes = std::min(bytes, m_bytesAcquired);
+    m_bytesAcquired -= bytes;
+    if (m_bytesPerSecond > 0) {
+        Refill(Clock::now());
+        m_byteTokens = std::min(m_byteTokens + static_cast<double>(bytes), m_bytesPerSecond * burst_seconds);
+    }
+}
+
+uint64_t IoThrottle::GetBytesAcquired() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytesAcquired;
+}
+
+uint64_t IoThrottle::GetOperationsAcquired() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_operationsAcquired;
+}
+
+// Add the tokens earned since the last refill; called with the mutex held
+void IoThrottle::Refill(Clock::time_point now) {
+    const double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+    m_lastRefill = now;
+    if (m_bytesPerSecond > 0) {
+        m_byteTokens = std::min(m_byteTokens + elapsed * m_bytesPerSecond, m_bytesPerSecond * burst_seconds);
+    }
+    if (m_operationsPerSecond > 0) {
+        m_operationTokens = std::min(m_operationTokens + elapsed * m_operationsPerSecond, m_operationsPerSecond * burst_seconds);
+    }
+}
+
+// Seconds until both buckets are out of debt; called with the mutex held
+double IoThrottle::Debt() const {
+    double seconds = 0;
+    if (m_bytesPerSecond > 0 && m_byteTokens < 0) {
+        seconds = std::max(seconds, -m_byteTokens / m_bytesPerSecond);
+    }
+    if (m_operationsPerSecond > 0 && m_operationTokens < 0) {
+        seconds = std::max(seconds, -m_operationTokens / m_operationsPerSecond);
+    }
+    return seconds;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Token bucket limiting the read bandwidth and the read operations per second of every thread
+// that shares it. A read takes its bytes and one operation from the buckets up front and, when
+// that leaves them in debt, sleeps until the debt is paid off, so waiting readers queue up
+// behind each other and the long-run rate matches the limit however large the reads are. Unused
+// capacity accumulates for a tenth of a second at most. The limits can be changed at any time,
+// including while other threads wait.
+class IoThrottle {
+public:
+    IoThrottle(const IoThrottle&) = delete;
+    IoThrottle& operator=(const IoThrottle&) = delete;
+
+    // A limit of 0 means no limit
+    explicit IoThrottle(uint64_t bytesPerSecond = 0, uint64_t operationsPerSecond = 0);
+
+    // Takes effect for every read from now on. Readers already waiting go ahead at once and any
+    // debt is forgiven, so a raised limit doesn't have to wait for the old one to pay off.
+    void SetLimits(uint64_t bytesPerSecond, uint64_t operationsPerSecond);
+    [[nodiscard]] uint64_t GetBytesPerSecond() const;
+    [[nodiscard]] uint64_t GetOperationsPerSecond() const;
+
+    // Wait until one read of `bytes` bytes fits the limits
+    void Acquire(uint64_t bytes);
+
+    // Give back bytes an acquired read did not return, as when it came back short, so that only
+    // the bytes actually read count against the limit
+    void Refund(uint64_t bytes);
+
+    // Bytes and operations that went through the throttle so far
+    [[nodiscard]] uint64_t GetBytesAcquired() const;
+    [[nodiscard]] uint64_t GetOperationsAcquired() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void Refill(Clock::time_point now);
+    [[nodiscard]] double Debt() const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_limitsChanged;
+    uint64_t m_bytesPerSecond;
+    uint64_t m_operationsPerSecond;
+    // Tokens in both buckets; negative while readers wait for their reads to be paid off
+    double m_byteTokens = 0;
+    double m_operationTokens = 0;
+    Clock::time_point m_lastRefill;
+    uint64_t m_generation = 0;
+    uint64_t m_bytesAcquired = 0;
+    uint64_t m_operationsAcquired = 0;
+};
@@ -0,0 +1,136 @@
+#include "log_pipeline.h"
+#include "text.h"
+
+#include <algorithm>
+#include <bit>
+
+void format_log_record(const LogRecord& record, std::wstring& text) {
+    switch (record.event) {
+    case LogEvent::Message:
+        text += record.text;
+        break;
+    case LogEvent::FileError:
+        text += L"Error processing file ";
+        text += path_to_wstring(record.path);
+        text += L": ";
+        text += record.text;
+        text += L"\r\n";
+        break;
+    case LogEvent::FileHashed:
+        text += L"Hashing completed: ";
+        text += path_to_wstring(record.path);
+        text += L"\r\n";
+        break;
+    case LogEvent::FileCompared:
+        text += L"Comparison completed: ";
+        text += path_to_wstring(record.path);
+        text += L"\r\n";
+        break;
+    }
+}
+
+LogPipeline::LogPipeline(LogCallback callback, size_t capacity, std::chrono::milliseconds flushInterval)
+    : m_callback(std::move(callback)), m_flushInterval(flushInterval) {
+    capacity = std::bit_ceil(std::max<size_t>(capacity, 2));
+    m_slots = std::make_unique<Slot[]>(capacity);
+    m_mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    m_thread = std::thread(&LogPipeline::ConsumerThread, this);
+}
+
+LogPipeline::~LogPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void LogPipeline::Post(LogRecord record) {
+    while (!TryPost(record)) {
+        // The ring is full: have the consumer flush now rather than at its next tick, and sleep
+        // until it has. A flush that freed slots before the lock was taken lets the retry through.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (TryPost(record)) {
+            return;
+        }
+        m_flushRequested = true;
+        m_wake.notify_one();
+        const uint64_t generation = m_flushGeneration;
+        m_spaceAvailable.wait(lock, [&] { return m_flushGeneration != generation || m_stopping; });
+    }
+}
+
+uint64_t LogPipeline::GetRecordCount() const noexcept {
+    return m_records.load(std::memory_order_relaxed);
+}
+
+uint64_t LogPipeline::GetFlushCount() const noexcept {
+    return m_flushes.load(std::memory_order_relaxed);
+}
+
+bool LogPipeline::TryPost(LogRecord& record) {
+    // A producer claims a position by moving m_enqueuePos past it, which it may only do while
+    // the slot there has been emptied by the consumer; the slot's sequence tells which it is
+    size_t position = m_enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = m_slots[position & m_mask];
+        const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+        if (difference == 0) {
+            if (m_enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.record = std::move(record);
+                slot.sequence.store(position + 1, std::memory_order_release);
+                m_records.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            return false;
+        }
+        else {
+            position = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void LogPipeline::Flush() {
+    // Records posted while the batch is formatted wait for the next one, so that a batch never
+    // holds more than a ring's worth
+    const size_t end = m_enqueuePos.load(std::memory_order_relaxed);
+    std::wstring text;
+    while (m_dequeuePos != end) {
+        Slot& slot = m_slots[m_dequeuePos & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1) {
+            break;
+        }
+        format_log_record(slot.record, text);
+        slot.record = LogRecord{};
+        slot.sequence.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+        ++m_dequeuePos;
+    }
+    if (!text.empty()) {
+        m_flushes.fetch_add(1, std::memory_order_relaxed);
+        m_callback(std::move(text));
+    }
+}
+
+void LogPipeline::ConsumerThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait_for(lock, m_flushInterval, [this] { return m_flushRequested || m_stopping; });
+        const bool stopping = m_stopping;
+        m_flushRequested = false;
+        lock.unlock();
+        Flush();
+        lock.lock();
+        ++m_flushGeneration;
+        m_spaceAvailable.notify_all();
+        if (stopping) {
+            return;
+        }
+    }
+}
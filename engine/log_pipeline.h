@@ -0,0 +1,120 @@
+#pragma once
+
+#include "hashing.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+// Verbosity of a log record; a record is only built when its level is at most the compiled one
+enum class LogLevel : uint8_t {
+    Error = 0,
+    Info = 1,
+    // One record per file, on the hot path of large scans
+    Debug = 2,
+};
+
+// The build picks the verbosity with DUPFINDER_LOG_LEVEL; records above it are compiled out
+#ifndef DUPFINDER_LOG_LEVEL
+#define DUPFINDER_LOG_LEVEL 2
+#endif
+
+constexpr LogLevel compiled_log_level = static_cast<LogLevel>(DUPFINDER_LOG_LEVEL);
+
+constexpr bool is_log_enabled(LogLevel level) {
+    return level <= compiled_log_level;
+}
+
+// What a log record reports. Records keep their fields as they are and are only turned into text
+// by the consumer, so posting one costs no formatting.
+enum class LogEvent : uint8_t {
+    // text as it is
+    Message,
+    // "Error processing file <path>: <text>"
+    FileError,
+    // "Hashing completed: <path>"
+    FileHashed,
+    // "Comparison completed: <path>"
+    FileCompared,
+};
+
+struct LogRecord {
+    LogLevel level = LogLevel::Info;
+    LogEvent event = LogEvent::Message;
+    fs::path path;
+    std::wstring text;
+};
+
+// Append the line the log callback gets for a record to text
+void format_log_record(const LogRecord& record, std::wstring& text);
+
+// Records waiting in the ring before a producer has to wait for the consumer
+constexpr size_t default_log_capacity = 16 * 1024;
+
+// Time between two flushes of the consumer
+constexpr std::chrono::milliseconds default_log_flush_interval{ 100 };
+
+// Bounded ring buffer of log records that any number of threads post to without taking a lock,
+// drained by a consumer thread of its own. The consumer formats what it finds every flush
+// interval and hands it to the callback as a single string, so the callback runs a few times per
+// second however many files the scan logs. A producer that finds the ring full wakes the
+// consumer early and waits for it, so no record is lost. The destructor flushes what is left.
+class LogPipeline {
+public:
+    LogPipeline(const LogPipeline&) = delete;
+    LogPipeline& operator=(const LogPipeline&) = delete;
+
+    // capacity is rounded up to a power of two
+    explicit LogPipeline(LogCallback callback, size_t capacity = default_log_capacity,
+        std::chrono::milliseconds flushInterval = default_log_flush_interval);
+    ~LogPipeline();
+
+    // Queue a record; waits only while the ring is full
+    void Post(LogRecord record);
+
+    // Records posted so far, and the times the callback was called with them
+    [[nodiscard]] uint64_t GetRecordCount() const noexcept;
+    [[nodiscard]] uint64_t GetFlushCount() const noexcept;
+
+private:
+    struct Slot {
+        // Position the slot expects next: the producer's position when it is free, one past
+        // it once it holds a record
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    bool TryPost(LogRecord& record);
+    // Format and hand over every record posted so far
+    void Flush();
+    void ConsumerThread();
+
+    LogCallback m_callback;
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+    std::chrono::milliseconds m_flushInterval;
+
+    std::atomic<size_t> m_enqueuePos{ 0 };
+    // Only the consumer moves it
+    size_t m_dequeuePos = 0;
+    std::atomic<uint64_t> m_records{ 0 };
+    std::atomic<uint64_t> m_flushes{ 0 };
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_spaceAvailable;
+    bool m_flushRequested = false;
+    // Flushes so far, which producers waiting for space watch
+    uint64_t m_flushGeneration = 0;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,235 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <csetjmp>
+#include <csignal>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Bytes of a mapped window handed over per throttled read
+constexpr size_t throttled_slice_size = 1024 * 1024;
+
+// Hand the callback part of a window; returns false when the file shrank under it. Defined per
+// platform below.
+bool read_window(const unsigned char* data, size_t length, const MappedWindowCallback& callback);
+
+// Pass a mapped window on to the callback, slice by slice when the reads are throttled
+void deliver_window(const fs::path& path, const unsigned char* data, size_t length, const MappedWindowCallback& callback, const ReadOptions& options) {
+    const size_t slice_size = options.throttle ? throttled_slice_size : length;
+    for (size_t offset = 0; offset < length; offset += slice_size) {
+        const size_t slice = std::min(slice_size, length - offset);
+        check_cancelled(options);
+        if (options.throttle) {
+            throttle_read(options, slice);
+        }
+        if (!read_window(data + offset, slice, callback)) {
+            throw std::runtime_error("File changed while reading: " + path.string());
+        }
+        count_read(options, slice);
+    }
+}
+
+} // namespace
+
+#ifdef _WIN32
+
+namespace {
+
+// Closes a Win32 handle when it goes out of scope
+struct HandleCloser {
+    HANDLE handle;
+
+    ~HandleCloser() {
+        if (handle && handle != INVALID_HANDLE_VALUE) {
+            ::CloseHandle(handle);
+        }
+    }
+};
+
+struct ViewUnmapper {
+    const void* view;
+
+    ~ViewUnmapper() {
+        ::UnmapViewOfFile(view);
+    }
+};
+
+// A view keeps the file from being truncated, so a read of it never faults for that reason
+bool read_window(const unsigned char* data, size_t length, const MappedWindowCallback& callback) {
+    callback(data, length);
+    return true;
+}
+
+} // namespace
+
+bool read_mapped_file(const fs::path& path, const MappedWindowCallback& callback, const ReadOptions& options) {
+    HandleCloser file{ ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+    if (file.handle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open file: " + path.string());
+    }
+
+    LARGE_INTEGER size{};
+    if (::GetFileType(file.handle) != FILE_TYPE_DISK || !::GetFileSizeEx(file.handle, &size)) {
+        return false;
+    }
+    if (size.QuadPart == 0) {
+        return true;
+    }
+
+    HandleCloser mapping{ ::CreateFileMappingW(file.handle, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+    if (!mapping.handle) {
+        return false;
+    }
+
+    // Window offsets are multiples of the window size, which is a multiple of the 64 KiB
+    // allocation granularity
+    const uint64_t total = static_cast<uint64_t>(size.QuadPart);
+    for (uint64_t offset = 0; offset < total; offset += mapped_window_size) {
+        const size_t length = static_cast<size_t>(std::min<uint64_t>(mapped_window_size, total - offset));
+        const void* view = ::MapViewOfFile(mapping.handle, FILE_MAP_READ,
+            static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset & 0xffffffff), length);
+        if (!view) {
+            if (offset == 0) {
+                return false;
+            }
+            throw std::runtime_error("Failed to map file: " + path.string());
+        }
+
+        ViewUnmapper unmapper{ view };
+        deliver_window(path, static_cast<const unsigned char*>(view), length, callback, options);
+    }
+
+    return true;
+}
+
+#else
+
+namespace {
+
+// Closes the file once every window is unmapped, dropping its pages first in Background mode
+struct FileCloser {
+    int fd;
+    ReadMode mode;
+    std::vector<unsigned char> resident;
+
+    ~FileCloser() {
+        release_cached_pages(fd, mode, resident);
+        ::close(fd);
+    }
+};
+
+struct WindowUnmapper {
+    void* data;
+    size_t length;
+
+    ~WindowUnmapper() {
+        ::munmap(data, length);
+    }
+};
+
+// Window the calling thread's callback is reading, which a SIGBUS inside it jumps back out of
+struct GuardedWindow {
+    const unsigned char* begin;
+    const unsigned char* end;
+    sigjmp_buf jump;
+};
+
+thread_local GuardedWindow* guarded_window = nullptr;
+struct sigaction previous_sigbus_action;
+
+void handle_sigbus(int, siginfo_t* info, void*) {
+    GuardedWindow* window = guarded_window;
+    const auto* address = static_cast<const unsigned char*>(info->si_addr);
+    if (window && address >= window->begin && address < window->end) {
+        siglongjmp(window->jump, 1);
+    }
+    // Not a fault of a guarded read: put the previous handling back and return to the faulting
+    // instruction, which faults again under it. A signal that was sent rather than raised by a
+    // fault is sent again.
+    ::sigaction(SIGBUS, &previous_sigbus_action, nullptr);
+    if (info->si_code <= 0) {
+        ::raise(SIGBUS);
+    }
+}
+
+void install_sigbus_handler() {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        struct sigaction action {};
+        action.sa_sigaction = handle_sigbus;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        ::sigaction(SIGBUS, &action, &previous_sigbus_action);
+    });
+}
+
+// Pages past the end of a file truncated while mapped raise SIGBUS when touched. The handler
+// jumps back here, abandoning the callback, which then only had plain reads of the window and
+// hasher updates on its stack.
+bool read_window(const unsigned char* data, size_t length, const MappedWindowCallback& callback) {
+    GuardedWindow window{ data, data + length, {} };
+    if (sigsetjmp(window.jump, 1) != 0) {
+        guarded_window = nullptr;
+        return false;
+    }
+    guarded_window = &window;
+    try {
+        callback(data, length);
+    }
+    catch (...) {
+        guarded_window = nullptr;
+        throw;
+    }
+    guarded_window = nullptr;
+    return true;
+}
+
+} // namespace
+
+bool read_mapped_file(const fs::path& path, const MappedWindowCallback& callback, const ReadOptions& options) {
+    install_sigbus_handler();
+    const int fd = open_for_reading(path, options.mode);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path.string());
+    }
+    FileCloser closer{ fd, options.mode, get_resident_pages(fd, options.mode) };
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    const uint64_t total = static_cast<uint64_t>(st.st_size);
+    for (uint64_t offset = 0; offset < total; offset += mapped_window_size) {
+        const size_t length = static_cast<size_t>(std::min<uint64_t>(mapped_window_size, total - offset));
+        void* data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(offset));
+        if (data == MAP_FAILED) {
+            if (offset == 0) {
+                return false;
+            }
+            throw std::runtime_error("Failed to map file: " + path.string());
+        }
+
+        WindowUnmapper unmapper{ data, length };
+        ::madvise(data, length, MADV_SEQUENTIAL);
+        deliver_window(path, static_cast<const unsigned char*>(data), length, callback, options);
+    }
+
+    return true;
+}
+
+#endif
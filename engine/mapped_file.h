@@ -0,0 +1,27 @@
+#pragma once
+
+#include "file_reader.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+
+namespace fs = std::filesystem;
+
+// Called with consecutive windows of a mapped file, in file order
+using MappedWindowCallback = std::function<void(const unsigned char* data, size_t size)>;
+
+// Bytes mapped at a time. Large enough that the map/unmap calls don't matter, small enough to
+// keep the address space use of many workers modest.
+constexpr size_t mapped_window_size = 64 * 1024 * 1024;
+
+// Read a whole regular file through read-only memory-mapped windows advised for sequential
+// access, so the content is hashed straight from the page cache without a copy. Returns false
+// without calling back when the file is not a regular file or can't be mapped, so that the caller
+// can fall back to stream reads; throws std::runtime_error when the file can't be opened or a
+// later window fails to map. A file truncated by another process while mapped faults on the pages
+// past its new end; on POSIX that SIGBUS is caught while the callback reads the window and turns
+// into a std::runtime_error for the file, so the callback must not leave anything half done that
+// a throw from inside it wouldn't. In Background mode the file is opened and released as
+// FileReader does. With a throttle the windows are handed over in throttled slices.
+bool read_mapped_file(const fs::path& path, const MappedWindowCallback& callback, const ReadOptions& options = {});
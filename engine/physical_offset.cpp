@@ -0,0 +1,68 @@
+#include "physical_offset.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+struct FileCloser {
+    int fd;
+
+    ~FileCloser() {
+        ::close(fd);
+    }
+};
+
+// Extents without a meaningful physical address
+constexpr uint32_t unplaced_extent_flags = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE
+    | FIEMAP_EXTENT_NOT_ALIGNED;
+
+} // namespace
+
+bool get_physical_offset(const fs::path& path, uint64_t& offset) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        return false;
+    }
+    FileCloser closer{ fd };
+
+    // Room for the header and the first extent
+    uint64_t buffer[(sizeof(fiemap) + sizeof(fiemap_extent)) / sizeof(uint64_t)] = {};
+    auto* map = reinterpret_cast<fiemap*>(buffer);
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    if (::ioctl(fd, FS_IOC_FIEMAP, map) == 0) {
+        if (map->fm_mapped_extents == 0 || (map->fm_extents[0].fe_flags & unplaced_extent_flags)) {
+            return false;
+        }
+        offset = map->fm_extents[0].fe_physical;
+        return true;
+    }
+    if (errno != EOPNOTSUPP && errno != ENOTTY) {
+        return false;
+    }
+
+    // Block 0 of the file mapped to a file system block; 0 means a hole
+    int block = 0;
+    int blockSize = 0;
+    if (::ioctl(fd, FIBMAP, &block) != 0 || block == 0 || ::ioctl(fd, FIGETBSZ, &blockSize) != 0) {
+        return false;
+    }
+    offset = static_cast<uint64_t>(block) * static_cast<uint64_t>(blockSize);
+    return true;
+}
+
+#else
+
+bool get_physical_offset(const fs::path&, uint64_t&) {
+    return false;
+}
+
+#endif
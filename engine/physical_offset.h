@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Find where the data of a file starts on its device, in bytes from the start of the file system,
+// through FIEMAP, or FIBMAP where FIEMAP is missing (which needs CAP_SYS_RAWIO). Returns false for
+// empty files, data that has no block yet (delayed allocation) or lives inline, and on platforms
+// other than Linux.
+bool get_physical_offset(const fs::path& path, uint64_t& offset);
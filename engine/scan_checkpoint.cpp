@@ -0,0 +1,223 @@
+#include "scan_checkpoint.h"
+#include "file_sync.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// File layout: magic and format version, the header, then one record per file, each starting
+// with a record tag, and an end tag; all in host byte order like the hash cache. A file record
+// is the path, size, link count and hard links, then the completed passes and, when there are
+// any, the identity and the digest of every completed pass. Paths are UTF-8 with a 32-bit length.
+constexpr char checkpoint_magic[4] = { 'D', 'F', 'C', 'P' };
+constexpr uint32_t checkpoint_version = 1;
+constexpr uint8_t file_tag = 1;
+constexpr uint8_t end_tag = 0;
+
+template<typename T>
+void put(std::ofstream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put_path(std::ofstream& out, const fs::path& path) {
+    const std::u8string text = path.u8string();
+    put<uint32_t>(out, static_cast<uint32_t>(text.size()));
+    out.write(reinterpret_cast<const char*>(text.data()), static_cast<std::streamsize>(text.size()));
+}
+
+void put_paths(std::ofstream& out, const std::vector<fs::path>& paths) {
+    put<uint64_t>(out, paths.size());
+    for (const auto& path : paths) {
+        put_path(out, path);
+    }
+}
+
+void put_digest(std::ofstream& out, const Digest& digest) {
+    put<uint8_t>(out, digest.size);
+    out.write(reinterpret_cast<const char*>(digest.bytes.data()), digest.size);
+}
+
+// Reads the fields of a checkpoint, throwing once the file ends early
+class CheckpointReader {
+public:
+    explicit CheckpointReader(const fs::path& path) : m_path(path), m_file(path, std::ios::binary) {
+        if (!m_file.is_open()) {
+            throw std::runtime_error("Failed to open checkpoint: " + path.string());
+        }
+        std::error_code ec;
+        m_size = fs::file_size(path, ec);
+        if (ec) {
+            throw std::runtime_error("Failed to open checkpoint: " + path.string());
+        }
+    }
+
+    template<typename T>
+    T Get() {
+        T value;
+        Read(&value, sizeof(value));
+        return value;
+    }
+
+    fs::path GetPath() {
+        // A damaged length must not make for a huge allocation
+        const uint32_t length = Get<uint32_t>();
+        if (length > Remaining()) {
+            throw std::runtime_error("Corrupt checkpoint: " + m_path.string());
+        }
+        std::u8string text(length, u8'\0');
+        Read(text.data(), text.size());
+        return fs::path(text);
+    }
+
+    std::vector<fs::path> GetPaths() {
+        const uint64_t count = Get<uint64_t>();
+        std::vector<fs::path> paths;
+        for (uint64_t i = 0; i < count; ++i) {
+            paths.push_back(GetPath());
+        }
+        return paths;
+    }
+
+    Digest GetDigest(HashAlgorithm algorithm) {
+        Digest digest;
+        digest.algorithm = algorithm;
+        digest.size = Get<uint8_t>();
+        if (digest.size > Digest::max_size) {
+            throw std::runtime_error("Corrupt checkpoint: " + m_path.string());
+        }
+        Read(digest.bytes.data(), digest.size);
+        return digest;
+    }
+
+    void Read(void* data, size_t size) {
+        if (!m_file.read(static_cast<char*>(data), static_cast<std::streamsize>(size))) {
+            throw std::runtime_error("Truncated checkpoint: " + m_path.string());
+        }
+    }
+
+private:
+    // Bytes of the file after the read position
+    uintmax_t Remaining() {
+        const std::streamoff position = m_file.tellg();
+        return position < 0 ? 0 : m_size - std::min<uintmax_t>(m_size, static_cast<uintmax_t>(position));
+    }
+
+    fs::path m_path;
+    std::ifstream m_file;
+    uintmax_t m_size = 0;
+};
+
+} // namespace
+
+ScanCheckpointWriter::ScanCheckpointWriter(fs::path path, const CheckpointHeader& header)
+    : m_path(std::move(path)) {
+    if (m_path.has_parent_path()) {
+        fs::create_directories(m_path.parent_path());
+    }
+    m_tempPath = m_path;
+    m_tempPath += ".tmp";
+    m_file.open(m_tempPath, std::ios::binary | std::ios::trunc);
+    if (!m_file.is_open()) {
+        throw std::runtime_error("Failed to create checkpoint: " + m_tempPath.string());
+    }
+
+    m_file.write(checkpoint_magic, sizeof(checkpoint_magic));
+    put<uint32_t>(m_file, checkpoint_version);
+    put_paths(m_file, header.roots);
+    put<uint8_t>(m_file, static_cast<uint8_t>(header.hash_algorithm));
+    put<uint64_t>(m_file, header.head_block_size);
+    put<uint64_t>(m_file, header.tail_block_size);
+    put<uint64_t>(m_file, header.middle_block_size);
+    put_paths(m_file, header.frontier);
+}
+
+void ScanCheckpointWriter::Add(const CheckpointFile& file) {
+    put<uint8_t>(m_file, file_tag);
+    put_path(m_file, file.path);
+    put<uint64_t>(m_file, file.size);
+    put<uint64_t>(m_file, file.link_count);
+    put_paths(m_file, file.links);
+    put<uint8_t>(m_file, file.passes);
+    if (file.passes == 0) {
+        return;
+    }
+
+    put<uint64_t>(m_file, file.identity.device);
+    put<uint64_t>(m_file, file.identity.inode);
+    put<uint64_t>(m_file, file.identity.size);
+    put<int64_t>(m_file, file.identity.mtime_ns);
+    put<int64_t>(m_file, file.identity.ctime_ns);
+    if (file.passes & CheckpointFile::HeadTailPass) {
+        put_digest(m_file, file.head_tail);
+    }
+    if (file.passes & CheckpointFile::MiddlePass) {
+        put_digest(m_file, file.middle);
+    }
+    if (file.passes & CheckpointFile::FullPass) {
+        put_digest(m_file, file.full);
+    }
+}
+
+void ScanCheckpointWriter::Commit() {
+    put<uint8_t>(m_file, end_tag);
+    if (!m_file.flush()) {
+        throw std::runtime_error("Failed to write checkpoint: " + m_tempPath.string());
+    }
+    m_file.close();
+    sync_file(m_tempPath);
+    fs::rename(m_tempPath, m_path);
+}
+
+ScanCheckpoint load_scan_checkpoint(const fs::path& path) {
+    CheckpointReader reader(path);
+
+    char magic[sizeof(checkpoint_magic)];
+    reader.Read(magic, sizeof(magic));
+    if (std::memcmp(magic, checkpoint_magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a checkpoint: " + path.string());
+    }
+    const uint32_t version = reader.Get<uint32_t>();
+    if (version != checkpoint_version) {
+        throw std::runtime_error("Unsupported checkpoint version " + std::to_string(version) + ": " + path.string());
+    }
+
+    ScanCheckpoint checkpoint;
+    CheckpointHeader& header = checkpoint.header;
+    header.roots = reader.GetPaths();
+    header.hash_algorithm = static_cast<HashAlgorithm>(reader.Get<uint8_t>());
+    header.head_block_size = reader.Get<uint64_t>();
+    header.tail_block_size = reader.Get<uint64_t>();
+    header.middle_block_size = reader.Get<uint64_t>();
+    header.frontier = reader.GetPaths();
+
+    while (reader.Get<uint8_t>() == file_tag) {
+        CheckpointFile& file = checkpoint.files.emplace_back();
+        file.path = reader.GetPath();
+        file.size = reader.Get<uint64_t>();
+        file.link_count = reader.Get<uint64_t>();
+        file.links = reader.GetPaths();
+        file.passes = reader.Get<uint8_t>();
+        if (file.passes == 0) {
+            continue;
+        }
+
+        file.identity.device = reader.Get<uint64_t>();
+        file.identity.inode = reader.Get<uint64_t>();
+        file.identity.size = reader.Get<uint64_t>();
+        file.identity.mtime_ns = reader.Get<int64_t>();
+        file.identity.ctime_ns = reader.Get<int64_t>();
+        if (file.passes & CheckpointFile::HeadTailPass) {
+            file.head_tail = reader.GetDigest(header.hash_algorithm);
+        }
+        if (file.passes & CheckpointFile::MiddlePass) {
+            file.middle = reader.GetDigest(header.hash_algorithm);
+        }
+        if (file.passes & CheckpointFile::FullPass) {
+            file.full = reader.GetDigest(header.hash_algorithm);
+        }
+    }
+    return checkpoint;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "digest.h"
+#include "file_identity.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// What a scan had done with one file by the time of a checkpoint
+struct CheckpointFile {
+    fs::path path;
+    uintmax_t size = 0;
+    uint64_t link_count = 0;
+    // Further hard links folded into the file
+    std::vector<fs::path> links;
+
+    // Passes the file completed, as bits of pass_bit, with their digests. The identity is the
+    // one the file had when it was read, which tells on resume whether the digests still hold.
+    uint8_t passes = 0;
+    FileIdentity identity;
+    Digest head_tail;
+    Digest middle;
+    Digest full;
+
+    enum : uint8_t {
+        HeadTailPass = 1,
+        MiddlePass = 2,
+        FullPass = 4,
+        // The final pass compared the file and it matched no other, so it has no full digest
+        UniquePass = 8,
+    };
+};
+
+// Scan options a checkpoint is only valid for, since its digests depend on them
+struct CheckpointHeader {
+    std::vector<fs::path> roots;
+    HashAlgorithm hash_algorithm = HashAlgorithm::Sha256;
+    uint64_t head_block_size = 0;
+    uint64_t tail_block_size = 0;
+    uint64_t middle_block_size = 0;
+
+    // Directories the traversal has yet to expand; the traversal is complete when it is empty
+    std::vector<fs::path> frontier;
+};
+
+// Everything a checkpoint holds, as read back for a resume
+struct ScanCheckpoint {
+    CheckpointHeader header;
+    // Every file the traversal found, in the order it found them
+    std::vector<CheckpointFile> files;
+};
+
+// Writes a checkpoint file by file, so that a scan of millions of files never holds a second
+// copy of its state. The file goes to a temporary path and is renamed over the checkpoint by
+// Commit once it is synced to disk, so neither a crash nor a power loss while writing leaves
+// anything but the previous checkpoint. Throws std::runtime_error when the file can't be written.
+class ScanCheckpointWriter {
+public:
+    ScanCheckpointWriter(const ScanCheckpointWriter&) = delete;
+    ScanCheckpointWriter& operator=(const ScanCheckpointWriter&) = delete;
+
+    ScanCheckpointWriter(fs::path path, const CheckpointHeader& header);
+
+    void Add(const CheckpointFile& file);
+    void Commit();
+
+private:
+    fs::path m_path;
+    fs::path m_tempPath;
+    std::ofstream m_file;
+};
+
+// Read a checkpoint. Throws std::runtime_error when it is missing, truncated, corrupt or of
+// another format version.
+ScanCheckpoint load_scan_checkpoint(const fs::path& path);
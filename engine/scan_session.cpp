@@ -0,0 +1,157 @@
+#include "scan_session.h"
+
+#include <algorithm>
+#include <set>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#endif
+
+VolumeUsage get_volume_usage(const std::vector<fs::path>& roots) {
+    VolumeUsage usage;
+#ifdef _WIN32
+    std::set<std::wstring> volumes;
+    for (const auto& root : roots) {
+        wchar_t volume[MAX_PATH];
+        if (!::GetVolumePathNameW(fs::absolute(root).c_str(), volume, MAX_PATH) || !volumes.insert(volume).second) {
+            continue;
+        }
+        ULARGE_INTEGER total{};
+        ULARGE_INTEGER available{};
+        if (::GetDiskFreeSpaceExW(volume, nullptr, &total, &available)) {
+            usage.used_bytes += total.QuadPart - available.QuadPart;
+        }
+    }
+#else
+    std::set<dev_t> devices;
+    for (const auto& root : roots) {
+        struct stat st;
+        struct statvfs vfs;
+        if (::stat(root.c_str(), &st) != 0 || !devices.insert(st.st_dev).second || ::statvfs(root.c_str(), &vfs) != 0) {
+            continue;
+        }
+        // File systems without a fixed inode table, like btrfs, report no inodes at all
+        if (vfs.f_files > vfs.f_ffree) {
+            usage.used_inodes += vfs.f_files - vfs.f_ffree;
+        }
+        usage.used_bytes += static_cast<uintmax_t>(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+    }
+#endif
+    return usage;
+}
+
+void estimate_scan_progress(ScanSnapshot& snapshot, const VolumeUsage& usage) {
+    snapshot.fraction = -1;
+    snapshot.eta_seconds = -1;
+    if (snapshot.stage == ScanStage::Done) {
+        snapshot.fraction = 1;
+        snapshot.eta_seconds = 0;
+        return;
+    }
+
+    // The traversal may walk more than the usage suggests when files change under it, so it
+    // never counts as done before it is
+    double traversed = 1;
+    if (snapshot.stage == ScanStage::Traversal) {
+        traversed = 0;
+        if (usage.used_inodes > 0) {
+            traversed = static_cast<double>(snapshot.entries_seen) / static_cast<double>(usage.used_inodes);
+        }
+        if (usage.used_bytes > 0) {
+            traversed = (std::max<double>)(traversed, static_cast<double>(snapshot.bytes_seen) / static_cast<double>(usage.used_bytes));
+        }
+        traversed = (std::min<double>)(traversed, 0.99);
+        if (traversed <= 0) {
+            return;
+        }
+    }
+    const double traversal_left = snapshot.elapsed_seconds * (1 - traversed) / traversed;
+
+    const double bytes_to_read = static_cast<double>(snapshot.bytes_expected) / traversed;
+    const double bytes_left = (std::max<double>)(0, bytes_to_read - static_cast<double>(snapshot.bytes_read));
+    double read_left = 0;
+    if (bytes_left > 0) {
+        if (snapshot.bytes_read == 0) {
+            return;
+        }
+        read_left = bytes_left * snapshot.elapsed_seconds / static_cast<double>(snapshot.bytes_read);
+    }
+
+    snapshot.eta_seconds = (std::max<double>)(traversal_left, read_left);
+    const double total = snapshot.elapsed_seconds + snapshot.eta_seconds;
+    snapshot.fraction = total > 0 ? snapshot.elapsed_seconds / total : 0;
+}
+
+ScanSession::ScanSession(std::vector<fs::path> roots, ScanOptions options, LogCallback logCallback)
+    : m_roots(std::move(roots)), m_options(std::move(options)), m_logCallback(std::move(logCallback)), m_usage(get_volume_usage(m_roots)),
+    m_startTime(std::chrono::steady_clock::now()) {
+    m_options.progress = &m_progress;
+    m_options.cancel = &m_cancel;
+    m_thread = std::thread(&ScanSession::Run, this);
+}
+
+ScanSession::~ScanSession() {
+    m_cancel.Cancel();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+ScanSnapshot ScanSession::GetSnapshot() const {
+    ScanSnapshot snapshot;
+    snapshot.stage = m_progress.stage.load(std::memory_order_relaxed);
+    snapshot.entries_seen = m_progress.entries_seen.load(std::memory_order_relaxed);
+    snapshot.bytes_seen = m_progress.bytes_seen.load(std::memory_order_relaxed);
+    snapshot.candidate_files = m_progress.candidate_files.load(std::memory_order_relaxed);
+    snapshot.bytes_expected = m_progress.bytes_expected.load(std::memory_order_relaxed);
+    snapshot.bytes_read = m_progress.bytes_read.load(std::memory_order_relaxed);
+    snapshot.groups_confirmed = m_progress.groups_confirmed.load(std::memory_order_relaxed);
+
+    const double duration = m_duration.load(std::memory_order_relaxed);
+    snapshot.elapsed_seconds = duration >= 0 ? duration : std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+    estimate_scan_progress(snapshot, m_usage);
+    return snapshot;
+}
+
+bool ScanSession::WaitFor(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_finishedChanged.wait_for(lock, timeout, [this] { return m_finished; });
+}
+
+bool ScanSession::IsFinished() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_finished;
+}
+
+DuplicateMap ScanSession::TakeResult(ScanSummary& summary) {
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+    summary = std::move(m_summary);
+    return std::move(m_result);
+}
+
+void ScanSession::Cancel() noexcept {
+    m_cancel.Cancel();
+}
+
+void ScanSession::Run() {
+    try {
+        m_result = find_duplicate_files(m_roots, m_options, m_summary, m_logCallback);
+    }
+    catch (...) {
+        m_error = std::current_exception();
+    }
+    m_duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+    m_progress.stage = ScanStage::Done;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_finished = true;
+    m_finishedChanged.notify_all();
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "cancellation.h"
+#include "duplicates.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Where a scan is. Reads of the head/tail pass already run while it is still in Traversal.
+enum class ScanStage {
+    Traversal,
+    HeadTail,
+    Middle,
+    Full,
+    Done,
+};
+
+// Counters a scan updates as it goes, for another thread to poll at any rate. Every field is a
+// relaxed atomic on its own, so the workers never wait for a reader; a set of values read
+// together may be a moment apart from each other.
+struct ScanProgress {
+    std::atomic<ScanStage> stage{ ScanStage::Traversal };
+    // Files and directories the traversal went through
+    std::atomic<uintmax_t> entries_seen{ 0 };
+    // Sum of the sizes of the files it found
+    std::atomic<uintmax_t> bytes_seen{ 0 };
+    // Files whose size was seen more than once, which have to be read
+    std::atomic<uintmax_t> candidate_files{ 0 };
+    // Bytes the reads issued so far are expected to read. Set to the bytes actually read at the
+    // end of every pass, since the cache and early mismatches read less.
+    std::atomic<uintmax_t> bytes_expected{ 0 };
+    // Bytes read by the hashing and comparison so far, updated while files are being read
+    std::atomic<uintmax_t> bytes_read{ 0 };
+    // Duplicate groups the scan is sure of
+    std::atomic<uintmax_t> groups_confirmed{ 0 };
+};
+
+// Space in use on a set of file systems, which a scan of all of them has to go through
+struct VolumeUsage {
+    // 0 where the file system doesn't tell, which includes every platform other than POSIX
+    uintmax_t used_inodes = 0;
+    uintmax_t used_bytes = 0;
+};
+
+// Used inodes and bytes of every distinct file system the roots are on, from statvfs. Roots that
+// are subtrees of a larger file system make this an overestimate.
+VolumeUsage get_volume_usage(const std::vector<fs::path>& roots);
+
+// A consistent-enough copy of the progress of a scan with an estimate of the time left
+struct ScanSnapshot {
+    ScanStage stage = ScanStage::Traversal;
+    uintmax_t entries_seen = 0;
+    uintmax_t bytes_seen = 0;
+    uintmax_t candidate_files = 0;
+    uintmax_t bytes_expected = 0;
+    uintmax_t bytes_read = 0;
+    uintmax_t groups_confirmed = 0;
+    double elapsed_seconds = 0;
+    // Share of the work done between 0 and 1 and the seconds left, both negative while there is
+    // nothing to estimate them from yet
+    double fraction = -1;
+    double eta_seconds = -1;
+};
+
+// Estimate how far a scan is from its counters and the usage of the file systems it walks. The
+// traversal is as far as the larger of its shares of the used inodes and bytes. The bytes still
+// to read are the expected ones scaled up to the whole traversal, at the rate read so far; reads
+// overlap the traversal, so the time left is the longer of the two. A pass only adds its bytes
+// once it starts, so the estimate goes up at the start of the middle and full passes.
+void estimate_scan_progress(ScanSnapshot& snapshot, const VolumeUsage& usage);
+
+// Runs find_duplicate_files on a thread of its own, so that the caller stays responsive and can
+// poll its progress while the engine's workers do the scan
+class ScanSession {
+public:
+    ScanSession(const ScanSession&) = delete;
+    ScanSession& operator=(const ScanSession&) = delete;
+
+    // Starts the scan at once. The log callback gets batches of lines on a thread of the scan.
+    ScanSession(std::vector<fs::path> roots, ScanOptions options, LogCallback logCallback = [](std::wstring) {});
+    // Cancels the scan and waits for it to stop
+    ~ScanSession();
+
+    // Never blocks the scan, so it can be called as often as a timer fires
+    [[nodiscard]] ScanSnapshot GetSnapshot() const;
+
+    // Wait up to timeout for the scan to finish; true once it has
+    bool WaitFor(std::chrono::milliseconds timeout);
+    [[nodiscard]] bool IsFinished() const;
+
+    // Wait for the scan and take its result, rethrowing what the scan threw. Call once.
+    DuplicateMap TakeResult(ScanSummary& summary);
+
+    // Ask the scan to stop; it finishes soon after and TakeResult throws ScanCancelled. Safe to
+    // call from any thread, and more than once.
+    void Cancel() noexcept;
+
+private:
+    void Run();
+
+    std::vector<fs::path> m_roots;
+    ScanOptions m_options;
+    LogCallback m_logCallback;
+    VolumeUsage m_usage;
+    std::chrono::steady_clock::time_point m_startTime;
+    // Seconds the scan took, negative while it runs
+    std::atomic<double> m_duration{ -1 };
+    ScanProgress m_progress;
+    CancellationToken m_cancel;
+
+    DuplicateMap m_result;
+    ScanSummary m_summary;
+    std::exception_ptr m_error;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_finishedChanged;
+    bool m_finished = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,342 @@
+#include "sha256_batch.h"
+
+#include <openssl/sha.h>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DUPFINDER_SHA256_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions in functions that ask for them, MSVC always can
+#if defined(__GNUC__) || defined(__clang__)
+#define DUPFINDER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DUPFINDER_TARGET_AVX2
+#endif
+
+namespace {
+
+constexpr size_t lane_count = 8;
+constexpr size_t block_size = 64;
+
+constexpr uint32_t initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+void scalar_batch(const unsigned char* const* messages, const size_t* sizes, size_t count, Digest* digests) {
+    for (size_t i = 0; i < count; ++i) {
+        digests[i] = Digest();
+        digests[i].algorithm = HashAlgorithm::Sha256;
+        digests[i].size = SHA256_DIGEST_LENGTH;
+        SHA256(messages[i], sizes[i], digests[i].bytes.data());
+    }
+}
+
+#ifdef DUPFINDER_SHA256_AVX2
+
+struct CpuFeatures {
+    bool avx2 = false;
+    bool sha = false;
+};
+
+CpuFeatures detect_cpu_features() {
+    unsigned regs1[4] = {};
+    unsigned regs7[4] = {};
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuidex(info, 1, 0);
+    std::memcpy(regs1, info, sizeof(regs1));
+    if (max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        std::memcpy(regs7, info, sizeof(regs7));
+    }
+#else
+    const unsigned max_leaf = __get_cpuid_max(0, nullptr);
+    __get_cpuid_count(1, 0, &regs1[0], &regs1[1], &regs1[2], &regs1[3]);
+    if (max_leaf >= 7) {
+        __get_cpuid_count(7, 0, &regs7[0], &regs7[1], &regs7[2], &regs7[3]);
+    }
+#endif
+
+    CpuFeatures features;
+    // AVX2 also needs the OS to save the YMM registers on context switches
+    const bool osxsave = (regs1[2] & (1u << 27)) != 0;
+    if (osxsave) {
+#if defined(_MSC_VER)
+        const unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned eax = 0, edx = 0;
+        __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        const unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+        features.avx2 = (xcr0 & 6) == 6 && (regs7[1] & (1u << 5)) != 0;
+    }
+    features.sha = (regs7[1] & (1u << 29)) != 0;
+    return features;
+}
+
+const CpuFeatures& cpu_features() {
+    static const CpuFeatures features = detect_cpu_features();
+    return features;
+}
+
+alignas(32) constexpr uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+DUPFINDER_TARGET_AVX2 inline __m256i rotr(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+// Load word `first`..`first + 7` of every lane's block and transpose them, so that register i
+// holds big-endian word first + i of all eight lanes
+DUPFINDER_TARGET_AVX2 inline void load_words(const unsigned char* const* blocks, size_t first, __m256i* words) {
+    const __m256i byte_swap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    __m256i rows[lane_count];
+    for (size_t lane = 0; lane < lane_count; ++lane) {
+        rows[lane] = _mm256_shuffle_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[lane] + first * 4)), byte_swap);
+    }
+
+    const __m256i t0 = _mm256_unpacklo_epi32(rows[0], rows[1]);
+    const __m256i t1 = _mm256_unpackhi_epi32(rows[0], rows[1]);
+    const __m256i t2 = _mm256_unpacklo_epi32(rows[2], rows[3]);
+    const __m256i t3 = _mm256_unpackhi_epi32(rows[2], rows[3]);
+    const __m256i t4 = _mm256_unpacklo_epi32(rows[4], rows[5]);
+    const __m256i t5 = _mm256_unpackhi_epi32(rows[4], rows[5]);
+    const __m256i t6 = _mm256_unpacklo_epi32(rows[6], rows[7]);
+    const __m256i t7 = _mm256_unpackhi_epi32(rows[6], rows[7]);
+
+    const __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    const __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    const __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    const __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    const __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    const __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    const __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    const __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    words[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    words[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    words[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    words[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    words[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    words[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    words[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    words[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+// One compression of a 64-byte block per lane. state holds word i of all lanes in state[i].
+DUPFINDER_TARGET_AVX2 void compress_avx2(uint32_t (*state)[lane_count], const unsigned char* const* blocks) {
+    __m256i w[16];
+    load_words(blocks, 0, w);
+    load_words(blocks, 8, w + 8);
+
+    __m256i v[8];
+    for (size_t i = 0; i < 8; ++i) {
+        v[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(state[i]));
+    }
+    __m256i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+
+    for (size_t t = 0; t < 64; ++t) {
+        if (t >= 16) {
+            const __m256i w15 = w[(t - 15) & 15];
+            const __m256i w2 = w[(t - 2) & 15];
+            const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(w15, 7), rotr(w15, 18)), _mm256_srli_epi32(w15, 3));
+            const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(w2, 17), rotr(w2, 19)), _mm256_srli_epi32(w2, 10));
+            w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+        }
+
+        const __m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(rotr(e, 6), rotr(e, 11)), rotr(e, 25));
+        const __m256i choose = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        const __m256i temp1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, sum1), choose),
+            _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(round_constants[t])), w[t & 15]));
+        const __m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(rotr(a, 2), rotr(a, 13)), rotr(a, 22));
+        const __m256i majority = _mm256_xor_si256(_mm256_and_si256(a, b),
+            _mm256_and_si256(c, _mm256_xor_si256(a, b)));
+        const __m256i temp2 = _mm256_add_epi32(sum0, majority);
+
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(temp1, temp2);
+    }
+
+    const __m256i result[8] = { a, b, c, d, e, f, g, h };
+    for (size_t i = 0; i < 8; ++i) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(state[i]), _mm256_add_epi32(v[i], result[i]));
+    }
+}
+
+// Message currently hashed in one lane. Whole blocks are read in place; the last partial block
+// and the padding are copied into tail.
+struct Lane {
+    size_t index = 0;
+    const unsigned char* data = nullptr;
+    size_t data_blocks = 0;
+    size_t total_blocks = 0;
+    size_t block = 0;
+    bool active = false;
+    unsigned char tail[2 * block_size];
+};
+
+void start_lane(Lane& lane, uint32_t (*state)[lane_count], size_t lane_index, size_t message_index, const unsigned char* data, size_t size) {
+    lane.index = message_index;
+    lane.data = data;
+    lane.data_blocks = size / block_size;
+    lane.block = 0;
+    lane.active = true;
+
+    const size_t remainder = size % block_size;
+    const size_t tail_blocks = remainder + 9 <= block_size ? 1 : 2;
+    lane.total_blocks = lane.data_blocks + tail_blocks;
+
+    std::memset(lane.tail, 0, sizeof(lane.tail));
+    if (remainder > 0) {
+        std::memcpy(lane.tail, data + lane.data_blocks * block_size, remainder);
+    }
+    lane.tail[remainder] = 0x80;
+    const uint64_t bit_length = static_cast<uint64_t>(size) * 8;
+    unsigned char* length = lane.tail + tail_blocks * block_size - 8;
+    for (int i = 0; i < 8; ++i) {
+        length[i] = static_cast<unsigned char>(bit_length >> (56 - 8 * i));
+    }
+
+    for (size_t i = 0; i < 8; ++i) {
+        state[i][lane_index] = initial_state[i];
+    }
+}
+
+void avx2_batch(const unsigned char* const* messages, const size_t* sizes, size_t count, Digest* digests) {
+    alignas(32) uint32_t state[8][lane_count];
+    alignas(32) static constexpr unsigned char idle_block[block_size] = {};
+    Lane lanes[lane_count];
+
+    size_t next = 0;
+    size_t active = 0;
+    for (size_t i = 0; i < lane_count && next < count; ++i, ++next, ++active) {
+        start_lane(lanes[i], state, i, next, messages[next], sizes[next]);
+    }
+
+    while (active > 0) {
+        const unsigned char* blocks[lane_count];
+        for (size_t i = 0; i < lane_count; ++i) {
+            const Lane& lane = lanes[i];
+            if (!lane.active) {
+                blocks[i] = idle_block;
+            }
+            else if (lane.block < lane.data_blocks) {
+                blocks[i] = lane.data + lane.block * block_size;
+            }
+            else {
+                blocks[i] = lane.tail + (lane.block - lane.data_blocks) * block_size;
+            }
+        }
+
+        compress_avx2(state, blocks);
+
+        for (size_t i = 0; i < lane_count; ++i) {
+            Lane& lane = lanes[i];
+            if (!lane.active || ++lane.block < lane.total_blocks) {
+                continue;
+            }
+
+            Digest& digest = digests[lane.index];
+            digest = Digest();
+            digest.algorithm = HashAlgorithm::Sha256;
+            digest.size = SHA256_DIGEST_LENGTH;
+            for (size_t word = 0; word < 8; ++word) {
+                const uint32_t value = state[word][i];
+                digest.bytes[word * 4] = static_cast<unsigned char>(value >> 24);
+                digest.bytes[word * 4 + 1] = static_cast<unsigned char>(value >> 16);
+                digest.bytes[word * 4 + 2] = static_cast<unsigned char>(value >> 8);
+                digest.bytes[word * 4 + 3] = static_cast<unsigned char>(value);
+            }
+
+            if (next < count) {
+                start_lane(lane, state, i, next, messages[next], sizes[next]);
+                ++next;
+            }
+            else {
+                lane.active = false;
+                --active;
+            }
+        }
+    }
+}
+
+#endif // DUPFINDER_SHA256_AVX2
+
+} // namespace
+
+bool is_sha256_batch_kernel_supported(Sha256BatchKernel kernel) {
+    switch (kernel) {
+    case Sha256BatchKernel::Scalar:
+        return true;
+    case Sha256BatchKernel::Avx2:
+#ifdef DUPFINDER_SHA256_AVX2
+        return cpu_features().avx2;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+Sha256BatchKernel sha256_batch_default_kernel() {
+#ifdef DUPFINDER_SHA256_AVX2
+    if (cpu_features().avx2 && !cpu_features().sha) {
+        return Sha256BatchKernel::Avx2;
+    }
+#endif
+    return Sha256BatchKernel::Scalar;
+}
+
+const char* sha256_batch_kernel_name(Sha256BatchKernel kernel) {
+    switch (kernel) {
+    case Sha256BatchKernel::Scalar:
+        return "scalar";
+    case Sha256BatchKernel::Avx2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+void sha256_batch(const unsigned char* const* messages, const size_t* sizes, size_t count, Digest* digests) {
+    static const Sha256BatchKernel kernel = sha256_batch_default_kernel();
+    sha256_batch(messages, sizes, count, digests, kernel);
+}
+
+void sha256_batch(const unsigned char* const* messages, const size_t* sizes, size_t count, Digest* digests, Sha256BatchKernel kernel) {
+#ifdef DUPFINDER_SHA256_AVX2
+    // A single message would leave seven of the eight lanes idle
+    if (kernel == Sha256BatchKernel::Avx2 && count > 1 && cpu_features().avx2) {
+        avx2_batch(messages, sizes, count, digests);
+        return;
+    }
+#endif
+    scalar_batch(messages, sizes, count, digests);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "digest.h"
+
+#include <cstddef>
+
+// Implementations of sha256_batch
+enum class Sha256BatchKernel {
+    // One message after the other through OpenSSL, which uses the SHA extensions where present
+    Scalar,
+    // Eight messages side by side in the 32-bit lanes of AVX2 registers
+    Avx2,
+};
+
+bool is_sha256_batch_kernel_supported(Sha256BatchKernel kernel);
+
+// Kernel sha256_batch picks on this CPU: AVX2 unless the CPU has the SHA extensions, whose
+// single-stream throughput the eight lanes don't beat
+Sha256BatchKernel sha256_batch_default_kernel();
+
+const char* sha256_batch_kernel_name(Sha256BatchKernel kernel);
+
+// SHA-256 of `count` independent in-memory messages. The multi-buffer kernel refills a lane as
+// soon as its message is done, so batches of similar sizes keep every lane busy.
+void sha256_batch(const unsigned char* const* messages, const size_t* sizes, size_t count, Digest* digests);
+void sha256_batch(const unsigned char* const* messages, const size_t* sizes, size_t count, Digest* digests, Sha256BatchKernel kernel);
@@ -0,0 +1,87 @@
+#include "shared_extents.h"
+
+#ifdef __linux__
+
+#include <memory>
+
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+// Extents fetched per FIEMAP call
+constexpr unsigned extents_per_call = 64;
+
+// Extents whose physical address doesn't pin down the data
+constexpr uint32_t unusable_extent_flags = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_ENCODED
+    | FIEMAP_EXTENT_DATA_ENCRYPTED | FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_DATA_TAIL
+    | FIEMAP_EXTENT_UNWRITTEN;
+
+struct FileCloser {
+    int fd;
+
+    ~FileCloser() {
+        ::close(fd);
+    }
+};
+
+} // namespace
+
+bool get_shared_extents(const fs::path& path, std::vector<FileExtent>& extents) {
+    extents.clear();
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        return false;
+    }
+    FileCloser closer{ fd };
+
+    const size_t bufferSize = sizeof(fiemap) + extents_per_call * sizeof(fiemap_extent);
+    auto buffer = std::make_unique<uint64_t[]>((bufferSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    auto* map = reinterpret_cast<fiemap*>(buffer.get());
+
+    uint64_t start = 0;
+    for (;;) {
+        *map = fiemap{};
+        map->fm_start = start;
+        map->fm_length = FIEMAP_MAX_OFFSET - start;
+        map->fm_extent_count = extents_per_call;
+        // Dirty pages are written back first: XFS keeps an overwrite of a reflinked file in its
+        // CoW fork until then, and the data fork would still report the old shared extent
+        map->fm_flags = FIEMAP_FLAG_SYNC;
+        if (::ioctl(fd, FS_IOC_FIEMAP, map) != 0 || map->fm_mapped_extents == 0) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < map->fm_mapped_extents; ++i) {
+            const fiemap_extent& extent = map->fm_extents[i];
+            if (!(extent.fe_flags & FIEMAP_EXTENT_SHARED) || (extent.fe_flags & unusable_extent_flags)) {
+                extents.clear();
+                return false;
+            }
+            extents.push_back({ extent.fe_logical, extent.fe_physical, extent.fe_length });
+            if (extent.fe_flags & FIEMAP_EXTENT_LAST) {
+                return true;
+            }
+        }
+
+        const fiemap_extent& last = map->fm_extents[map->fm_mapped_extents - 1];
+        start = last.fe_logical + last.fe_length;
+    }
+
+    // Either FIEMAP failed or the file has no data at all
+    extents.clear();
+    return false;
+}
+
+#else
+
+bool get_shared_extents(const fs::path&, std::vector<FileExtent>& extents) {
+    extents.clear();
+    return false;
+}
+
+#endif
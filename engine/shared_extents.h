@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// A run of a file's bytes and where the file system stores it
+struct FileExtent {
+    uint64_t logical = 0;
+    uint64_t physical = 0;
+    uint64_t length = 0;
+
+    bool operator==(const FileExtent& other) const = default;
+};
+
+// Read the extent map of a file whose data is entirely shared with other files, as reflink copies
+// on btrfs or XFS are. Two files of one size on one device with equal maps read the same blocks,
+// so their content is identical without reading it. Returns false when any extent is not shared
+// or its location is not final (delayed allocation, inline or compressed data), when the file
+// is empty, and when the file system or the platform (anything but Linux) has no FIEMAP.
+bool get_shared_extents(const fs::path& path, std::vector<FileExtent>& extents);
@@ -0,0 +1,141 @@
+#include "sparse_file.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <winioctl.h>
+#else
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+namespace {
+
+// Closes a Win32 handle when it goes out of scope
+struct HandleCloser {
+    HANDLE handle;
+
+    ~HandleCloser() {
+        if (handle != INVALID_HANDLE_VALUE) {
+            ::CloseHandle(handle);
+        }
+    }
+};
+
+// Allocated ranges fetched per call
+constexpr DWORD ranges_per_call = 64;
+
+} // namespace
+
+bool is_sparse_file(const fs::path& path) {
+    const DWORD attributes = ::GetFileAttributesW(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_SPARSE_FILE);
+}
+
+bool get_data_segments(const fs::path& path, std::vector<std::pair<uintmax_t, uintmax_t>>& segments) {
+    segments.clear();
+
+    HandleCloser file{ ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, 0, nullptr) };
+    LARGE_INTEGER size{};
+    if (file.handle == INVALID_HANDLE_VALUE || !::GetFileSizeEx(file.handle, &size)) {
+        return false;
+    }
+
+    FILE_ALLOCATED_RANGE_BUFFER query{};
+    query.Length.QuadPart = size.QuadPart;
+    FILE_ALLOCATED_RANGE_BUFFER ranges[ranges_per_call];
+    for (;;) {
+        DWORD returned = 0;
+        const BOOL complete = ::DeviceIoControl(file.handle, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+            ranges, sizeof(ranges), &returned, nullptr);
+        if (!complete && ::GetLastError() != ERROR_MORE_DATA) {
+            segments.clear();
+            return false;
+        }
+
+        const DWORD count = returned / sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+        for (DWORD i = 0; i < count; ++i) {
+            segments.emplace_back(static_cast<uintmax_t>(ranges[i].FileOffset.QuadPart), static_cast<uintmax_t>(ranges[i].Length.QuadPart));
+        }
+        if (complete || count == 0) {
+            return true;
+        }
+
+        // Continue after the last range returned
+        const auto& last = ranges[count - 1];
+        query.FileOffset.QuadPart = last.FileOffset.QuadPart + last.Length.QuadPart;
+        query.Length.QuadPart = size.QuadPart - query.FileOffset.QuadPart;
+    }
+}
+
+#else
+
+namespace {
+
+struct FileCloser {
+    int fd;
+
+    ~FileCloser() {
+        ::close(fd);
+    }
+};
+
+} // namespace
+
+bool is_sparse_file(const fs::path& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)
+        && static_cast<uintmax_t>(st.st_blocks) * 512 < static_cast<uintmax_t>(st.st_size);
+}
+
+bool get_data_segments(const fs::path& path, std::vector<std::pair<uintmax_t, uintmax_t>>& segments) {
+    segments.clear();
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    FileCloser closer{ fd };
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    const off_t size = st.st_size;
+    off_t offset = 0;
+    while (offset < size) {
+        const off_t data = ::lseek(fd, offset, SEEK_DATA);
+        if (data < 0) {
+            // ENXIO: nothing but a hole up to the end
+            if (errno == ENXIO) {
+                break;
+            }
+            segments.clear();
+            return false;
+        }
+        off_t hole = ::lseek(fd, data, SEEK_HOLE);
+        if (hole < 0) {
+            segments.clear();
+            return false;
+        }
+        hole = std::min(hole, size);
+        if (hole > data) {
+            segments.emplace_back(static_cast<uintmax_t>(data), static_cast<uintmax_t>(hole - data));
+        }
+        offset = hole;
+    }
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Whether the file system reports fewer allocated bytes than the size of the file, which is
+// what holes look like from the outside. Costs one stat call and never opens the file.
+bool is_sparse_file(const fs::path& path);
+
+// List the ranges of a file that hold data, as offset and length in file order, through
+// SEEK_DATA/SEEK_HOLE on POSIX and FSCTL_QUERY_ALLOCATED_RANGES on Windows. Everything between
+// them is a hole that reads as zeros. Returns false when the file system can't tell, in which
+// case the whole file has to be read.
+bool get_data_segments(const fs::path& path, std::vector<std::pair<uintmax_t, uintmax_t>>& segments);
@@ -0,0 +1,26 @@
+#include "text.h"
+
+#include <cstring>
+
+std::wstring convert_to_wstring(const char* narrow_str) {
+    if (!narrow_str) return L"";
+    return std::wstring(narrow_str, narrow_str + std::strlen(narrow_str));
+}
+
+std::wstring path_to_wstring(const fs::path& path) {
+    try {
+        return path.wstring();
+    }
+    catch (const std::exception&) {
+        return convert_to_wstring(path.string().c_str());
+    }
+}
+
+std::string convert_to_string(const std::wstring& wide_str) {
+    std::string result;
+    result.reserve(wide_str.size());
+    for (wchar_t c : wide_str) {
+        result.push_back(static_cast<unsigned long>(c) < 0x80 ? static_cast<char>(c) : '?');
+    }
+    return result;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Widen a narrow (ASCII or UTF-8 error message) string byte by byte
+std::wstring convert_to_wstring(const char* narrow_str);
+
+// Convert a path for display. Unlike fs::path::wstring() this never throws on names that are
+// not valid in the native encoding; offending bytes are widened as-is.
+std::wstring path_to_wstring(const fs::path& path);
+
+// Narrow a wide string for console output, replacing characters outside of ASCII with '?'
+std::string convert_to_string(const std::wstring& wide_str);
@@ -0,0 +1,83 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount)
+    : m_threadCount(threadCount ? threadCount : DefaultThreadCount()) {
+    if (m_threadCount > 1) {
+        m_threads.reserve(m_threadCount);
+        for (unsigned i = 0; i < m_threadCount; ++i) {
+            m_threads.emplace_back(&ThreadPool::WorkerThread, this);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_taskAvailable.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    if (m_threads.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        ++m_unfinished;
+    }
+    m_taskAvailable.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_tasksDone.wait(lock, [this] { return m_unfinished == 0; });
+}
+
+bool ThreadPool::WaitFor(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_tasksDone.wait_for(lock, timeout, [this] { return m_unfinished == 0; });
+}
+
+unsigned ThreadPool::GetThreadCount() const noexcept {
+    return m_threadCount;
+}
+
+unsigned ThreadPool::DefaultThreadCount() noexcept {
+    unsigned count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+void ThreadPool::WorkerThread() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_taskAvailable.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        // Tasks are expected to report their own errors
+        try {
+            task();
+        }
+        catch (...) {
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_unfinished == 0) {
+            m_tasksDone.notify_all();
+        }
+    }
+}
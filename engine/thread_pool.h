@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads running submitted tasks in FIFO order.
+// A pool created with a single thread runs every task inline on the submitting thread.
+class ThreadPool {
+public:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Zero thread count means one thread per hardware thread
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    void Submit(std::function<void()> task);
+
+    // Block until every submitted task has finished
+    void Wait();
+    // The same for at most timeout; true when every task has finished
+    bool WaitFor(std::chrono::milliseconds timeout);
+
+    [[nodiscard]] unsigned GetThreadCount() const noexcept;
+
+    static unsigned DefaultThreadCount() noexcept;
+
+private:
+    void WorkerThread();
+
+    unsigned m_threadCount;
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_tasksDone;
+    size_t m_unfinished = 0;
+    bool m_stopping = false;
+};
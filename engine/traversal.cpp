@@ -0,0 +1,371 @@
+#include "traversal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Files collected by a worker before they are published to the consumer
+constexpr size_t batch_size = 256;
+
+// Published batches waiting for the consumer before workers block
+constexpr size_t max_queued_batches = 64;
+
+#ifdef __linux__
+
+// Directory records fetched per getdents64 call; large enough for most directories in one call
+constexpr size_t getdents_buffer_size = 256 * 1024;
+
+// Record layout of getdents64, which glibc doesn't declare
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+#endif
+
+} // namespace
+
+#ifdef __linux__
+
+struct ParallelTraverser::DirectoryHandle {
+    int fd;
+
+    explicit DirectoryHandle(int fd) : fd(fd) {}
+    DirectoryHandle(const DirectoryHandle&) = delete;
+    DirectoryHandle& operator=(const DirectoryHandle&) = delete;
+
+    ~DirectoryHandle() {
+        ::close(fd);
+    }
+};
+
+#else
+
+struct ParallelTraverser::DirectoryHandle {};
+
+#endif
+
+ParallelTraverser::ParallelTraverser(const std::vector<fs::path>& roots, unsigned threadCount, TraversalBackend backend)
+#ifdef __linux__
+    : m_backend(backend)
+#else
+    : m_backend(TraversalBackend::Filesystem)
+#endif
+{
+#ifndef __linux__
+    (void)backend;
+#endif
+    if (!threadCount) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    threadCount = std::max(threadCount, 1u);
+
+    for (unsigned i = 0; i < threadCount; ++i) {
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    // Spread the roots over the workers so that several roots start in parallel
+    for (size_t i = 0; i < roots.size(); ++i) {
+        PushDirectory(i % threadCount, { roots[i], nullptr });
+    }
+
+    m_runningWorkers = threadCount;
+    for (unsigned i = 0; i < threadCount; ++i) {
+        m_threads.emplace_back(&ParallelTraverser::WorkerThread, this, i);
+    }
+}
+
+ParallelTraverser::~ParallelTraverser() {
+    m_stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(m_outputMutex);
+        m_outputSpace.notify_all();
+    }
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+bool ParallelTraverser::Next(TraversalBatch& batch) {
+    std::unique_lock<std::mutex> lock(m_outputMutex);
+    m_outputAvailable.wait(lock, [this] { return !m_output.empty() || m_runningWorkers == 0; });
+    if (m_output.empty()) {
+        return false;
+    }
+
+    batch = std::move(m_output.front());
+    m_output.pop_front();
+    m_outputSpace.notify_one();
+    return true;
+}
+
+void ParallelTraverser::Pause() {
+    m_pausing = true;
+}
+
+std::vector<fs::path> ParallelTraverser::GetFrontier() {
+    std::vector<fs::path> frontier;
+    for (auto& queue : m_queues) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        for (const auto& directory : queue->directories) {
+            frontier.push_back(directory.path);
+        }
+    }
+    return frontier;
+}
+
+unsigned ParallelTraverser::GetThreadCount() const noexcept {
+    return static_cast<unsigned>(m_threads.size());
+}
+
+TraversalBackend ParallelTraverser::GetBackend() const noexcept {
+    return m_backend;
+}
+
+void ParallelTraverser::WorkerThread(size_t index) {
+    TraversalBatch batch;
+    auto backoff = std::chrono::microseconds(10);
+
+    while (!m_stopping && !m_pausing) {
+        PendingDirectory directory;
+        if (PopDirectory(index, directory) || StealDirectory(index, directory)) {
+            if (m_backend == TraversalBackend::Getdents) {
+                ExpandDirectoryGetdents(index, directory, batch);
+            }
+            else {
+                ExpandDirectory(index, directory.path, batch);
+            }
+            ++batch.directories;
+            // Drop the parent reference before looking for more work, so it closes early
+            directory = PendingDirectory{};
+            --m_pendingDirectories;
+            backoff = std::chrono::microseconds(10);
+            continue;
+        }
+
+        if (m_pendingDirectories == 0) {
+            break;
+        }
+
+        // Everything left is being expanded by other workers; hand over what we have and wait
+        // for them to push new subdirectories
+        Publish(batch);
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2, std::chrono::microseconds(1000));
+    }
+
+    Publish(batch);
+
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    if (--m_runningWorkers == 0) {
+        m_outputAvailable.notify_all();
+    }
+}
+
+void ParallelTraverser::PushDirectory(size_t index, PendingDirectory directory) {
+    ++m_pendingDirectories;
+    std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+    m_queues[index]->directories.push_back(std::move(directory));
+}
+
+bool ParallelTraverser::PopDirectory(size_t index, PendingDirectory& directory) {
+    // The owner works depth-first from the back of its deque
+    auto& queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.directories.empty()) {
+        return false;
+    }
+    directory = std::move(queue.directories.back());
+    queue.directories.pop_back();
+    return true;
+}
+
+bool ParallelTraverser::StealDirectory(size_t index, PendingDirectory& directory) {
+    // Thieves take from the front, where the shallowest and so largest subtrees are
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+        auto& queue = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.directories.empty()) {
+            directory = std::move(queue.directories.front());
+            queue.directories.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ParallelTraverser::ExpandDirectory(size_t index, const fs::path& directory, TraversalBatch& batch) {
+    std::error_code ec;
+    fs::directory_iterator it(directory, fs::directory_options::skip_permission_denied, ec);
+    if (ec) {
+        batch.errors.push_back({ directory, ec });
+        return;
+    }
+
+    for (; it != fs::directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            batch.errors.push_back({ directory, ec });
+            break;
+        }
+
+        const auto& entry = *it;
+        std::error_code entryEc;
+        if (entry.is_directory(entryEc) && !entry.is_symlink(entryEc)) {
+            PushDirectory(index, { entry.path(), nullptr });
+            continue;
+        }
+
+        if (!entry.is_regular_file(entryEc)) {
+            continue;
+        }
+
+#ifdef _WIN32
+        // The size comes with the directory listing, the file index would need the file opened
+        FileEntry file{ entry.path(), entry.file_size(entryEc), {}, false, 0 };
+        if (entryEc) {
+            batch.errors.push_back({ entry.path(), entryEc });
+            continue;
+        }
+#else
+        // One stat gives the size, the identity and the link count
+        struct stat st;
+        if (::stat(entry.path().c_str(), &st) != 0) {
+            batch.errors.push_back({ entry.path(), std::error_code(errno, std::generic_category()) });
+            continue;
+        }
+
+        FileEntry file{ entry.path(), static_cast<uintmax_t>(st.st_size), file_identity_from_stat(st), true,
+            static_cast<uint64_t>(st.st_nlink) };
+#endif
+
+        batch.files.push_back(std::move(file));
+        if (batch.files.size() >= batch_size) {
+            Publish(batch);
+        }
+    }
+}
+
+#ifdef __linux__
+
+void ParallelTraverser::ExpandDirectoryGetdents(size_t index, const PendingDirectory& directory, TraversalBatch& batch) {
+    // Subdirectories are opened by name relative to their parent; roots by their path, following
+    // a symbolic link like directory_iterator does. Links below the roots are never followed.
+    const int fd = directory.parent
+        ? ::openat(directory.parent->fd, directory.path.filename().c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+        : ::open(directory.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != EACCES) {
+            batch.errors.push_back({ directory.path, std::error_code(errno, std::generic_category()) });
+        }
+        return;
+    }
+    auto handle = std::make_shared<DirectoryHandle>(fd);
+
+    thread_local std::unique_ptr<char[]> buffer(new char[getdents_buffer_size]);
+    for (;;) {
+        const long length = ::syscall(SYS_getdents64, fd, buffer.get(), getdents_buffer_size);
+        if (length < 0) {
+            batch.errors.push_back({ directory.path, std::error_code(errno, std::generic_category()) });
+            break;
+        }
+        if (length == 0) {
+            break;
+        }
+
+        for (long offset = 0; offset < length;) {
+            const auto* record = reinterpret_cast<const LinuxDirent64*>(buffer.get() + offset);
+            offset += record->d_reclen;
+
+            const char* name = record->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            unsigned char type = record->d_type;
+            if (type == DT_DIR) {
+                PushDirectory(index, { directory.path / name, handle });
+                continue;
+            }
+            if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) {
+                continue;
+            }
+
+            // Regular files need their size anyway. Links are followed to what they point at, like
+            // is_regular_file does; a dangling one is skipped. Unknown types are looked at first.
+            struct stat st;
+            if (type == DT_UNKNOWN) {
+                if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    batch.errors.push_back({ directory.path / name, std::error_code(errno, std::generic_category()) });
+                    continue;
+                }
+                if (S_ISDIR(st.st_mode)) {
+                    PushDirectory(index, { directory.path / name, handle });
+                    continue;
+                }
+                type = S_ISLNK(st.st_mode) ? DT_LNK : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+                if (type == DT_UNKNOWN) {
+                    continue;
+                }
+            }
+            if (type == DT_LNK || record->d_type == DT_REG) {
+                if (::fstatat(fd, name, &st, 0) != 0) {
+                    if (type == DT_REG) {
+                        batch.errors.push_back({ directory.path / name, std::error_code(errno, std::generic_category()) });
+                    }
+                    continue;
+                }
+            }
+            if (!S_ISREG(st.st_mode)) {
+                continue;
+            }
+
+            FileEntry file{ directory.path / name, static_cast<uintmax_t>(st.st_size), file_identity_from_stat(st), true,
+                static_cast<uint64_t>(st.st_nlink) };
+            batch.files.push_back(std::move(file));
+            if (batch.files.size() >= batch_size) {
+                Publish(batch);
+            }
+        }
+    }
+}
+
+#else
+
+void ParallelTraverser::ExpandDirectoryGetdents(size_t index, const PendingDirectory& directory, TraversalBatch& batch) {
+    ExpandDirectory(index, directory.path, batch);
+}
+
+#endif
+
+void ParallelTraverser::Publish(TraversalBatch& batch) {
+    if (batch.files.empty() && batch.errors.empty() && batch.directories == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_outputMutex);
+    m_outputSpace.wait(lock, [this] { return m_output.size() < max_queued_batches || m_stopping; });
+    if (m_stopping) {
+        batch = TraversalBatch{};
+        return;
+    }
+    m_output.push_back(std::move(batch));
+    batch = TraversalBatch{};
+    m_outputAvailable.notify_one();
+}
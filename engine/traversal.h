@@ -0,0 +1,125 @@
+#pragma once
+
+#include "file_identity.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// How the traversal lists directories
+enum class TraversalBackend {
+    // std::filesystem::directory_iterator, plus a stat of every regular file for its size
+    Filesystem,
+    // Linux only: getdents64 into large buffers on directory descriptors opened relative to their
+    // parent. The entry type from the directory record decides what an entry is, so only regular
+    // files, symbolic links and entries of unknown type are stat'ed, relative to the directory.
+    Getdents,
+};
+
+#ifdef __linux__
+constexpr TraversalBackend default_traversal_backend = TraversalBackend::Getdents;
+#else
+constexpr TraversalBackend default_traversal_backend = TraversalBackend::Filesystem;
+#endif
+
+// A regular file found by the traversal
+struct FileEntry {
+    fs::path path;
+    uintmax_t size = 0;
+    // Filled from the stat call that also yields the size where the platform has one. Elsewhere
+    // has_identity is false and link_count 0, which means unknown.
+    FileIdentity identity;
+    bool has_identity = false;
+    uint64_t link_count = 0;
+};
+
+// A directory or file the traversal could not read
+struct TraversalError {
+    fs::path path;
+    std::error_code error;
+};
+
+// A chunk of traversal results handed from the traversal threads to the consumer
+struct TraversalBatch {
+    std::vector<FileEntry> files;
+    std::vector<TraversalError> errors;
+    // Directories expanded since the previous batch of the same thread
+    uintmax_t directories = 0;
+};
+
+// Walks directory trees on several threads. Every thread expands directories from its own deque
+// and steals from the other ones when it runs dry. Found files are streamed to the consumer in
+// batches through a bounded queue while the walk goes on. Symbolic links to directories are not
+// followed.
+class ParallelTraverser {
+public:
+    ParallelTraverser(const ParallelTraverser&) = delete;
+    ParallelTraverser& operator=(const ParallelTraverser&) = delete;
+
+    // Zero thread count means one thread per hardware thread. The Getdents backend falls back to
+    // Filesystem off Linux.
+    explicit ParallelTraverser(const std::vector<fs::path>& roots, unsigned threadCount = 0,
+        TraversalBackend backend = default_traversal_backend);
+    ~ParallelTraverser();
+
+    // Wait for the next batch of results. Returns false once the whole tree has been walked, or
+    // after a pause once the directories being expanded are done.
+    bool Next(TraversalBatch& batch);
+
+    // Stop taking up further directories. The ones being expanded are finished and their results
+    // still come through Next, so that nothing found is lost.
+    void Pause();
+    // Directories not expanded yet, once Next returned false after a pause; walking them with a
+    // new traverser finishes the walk. Empty when the walk is complete.
+    std::vector<fs::path> GetFrontier();
+
+    [[nodiscard]] unsigned GetThreadCount() const noexcept;
+    [[nodiscard]] TraversalBackend GetBackend() const noexcept;
+
+private:
+    // Open directory descriptor of the Getdents backend, closed with the last reference
+    struct DirectoryHandle;
+
+    // A directory waiting to be expanded. The Getdents backend keeps the parent open until all of
+    // its subdirectories have been, so that they can be opened by name.
+    struct PendingDirectory {
+        fs::path path;
+        std::shared_ptr<DirectoryHandle> parent;
+    };
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<PendingDirectory> directories;
+    };
+
+    void WorkerThread(size_t index);
+    void PushDirectory(size_t index, PendingDirectory directory);
+    bool PopDirectory(size_t index, PendingDirectory& directory);
+    bool StealDirectory(size_t index, PendingDirectory& directory);
+    void ExpandDirectory(size_t index, const fs::path& directory, TraversalBatch& batch);
+    void ExpandDirectoryGetdents(size_t index, const PendingDirectory& directory, TraversalBatch& batch);
+    void Publish(TraversalBatch& batch);
+
+    TraversalBackend m_backend;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    // Directories pushed but not expanded yet; the walk is complete when it drops to zero
+    std::atomic<size_t> m_pendingDirectories{ 0 };
+    std::atomic<bool> m_stopping{ false };
+    std::atomic<bool> m_pausing{ false };
+
+    std::mutex m_outputMutex;
+    std::condition_variable m_outputAvailable;
+    std::condition_variable m_outputSpace;
+    std::deque<TraversalBatch> m_output;
+    size_t m_runningWorkers = 0;
+};
@@ -0,0 +1,641 @@
+#include "uring_reader.h"
+#include "cancellation.h"
+#include "thread_pool.h"
+
+#include <stdexcept>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+// Size of every registered read buffer
+constexpr size_t uring_buffer_size = 256 * 1024;
+
+// Largest ring io_uring_setup accepts (IORING_MAX_ENTRIES); deeper queues fail with EINVAL
+constexpr unsigned uring_max_entries = 32768;
+
+// Reads in flight at most, whatever the queue depth, which keeps the buffers to 1 GiB
+constexpr unsigned uring_max_buffers = 4096;
+
+int sys_io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+// Minimal io_uring instance over the raw system calls: one submission and one completion ring,
+// driven from a single thread
+class IoUring {
+public:
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    explicit IoUring(unsigned entries) {
+        io_uring_params params{};
+        m_fd = sys_io_uring_setup(entries, &params);
+        if (m_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+        m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            Close();
+            throw std::system_error(errno, std::generic_category(), "mmap io_uring");
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            m_cqRing = m_sqRing;
+        }
+        else {
+            m_cqRing = ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        }
+        m_sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+        if (m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED) {
+            Close();
+            throw std::system_error(errno, std::generic_category(), "mmap io_uring");
+        }
+
+        auto* sq = static_cast<unsigned char*>(m_sqRing);
+        m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqEntries = params.sq_entries;
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto* cq = static_cast<unsigned char*>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~IoUring() {
+        Close();
+    }
+
+    bool RegisterBuffers(const iovec* buffers, unsigned count) {
+        return sys_io_uring_register(m_fd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+    }
+
+    bool RegisterFiles(const int* fds, unsigned count) {
+        return sys_io_uring_register(m_fd, IORING_REGISTER_FILES, fds, count) == 0;
+    }
+
+    bool UpdateFile(unsigned slot, int fd) {
+        io_uring_files_update update{};
+        update.offset = slot;
+        update.fds = reinterpret_cast<uint64_t>(&fd);
+        return sys_io_uring_register(m_fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1;
+    }
+
+    // Next free submission entry, zeroed. The caller never queues more entries than the ring holds.
+    io_uring_sqe* NextSqe() {
+        const unsigned tail = *m_sqTail + m_queued;
+        io_uring_sqe* sqe = &m_sqes[tail & m_sqMask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[tail & m_sqMask] = tail & m_sqMask;
+        ++m_queued;
+        return sqe;
+    }
+
+    // Publish the queued entries and, when waitCount is not zero, block until that many
+    // completions are available
+    void Submit(unsigned waitCount) {
+        const unsigned toSubmit = m_queued;
+        if (toSubmit > 0) {
+            std::atomic_ref<unsigned>(*m_sqTail).store(*m_sqTail + toSubmit, std::memory_order_release);
+            m_queued = 0;
+        }
+
+        unsigned submitted = 0;
+        while (submitted < toSubmit || waitCount > 0) {
+            int result = sys_io_uring_enter(m_fd, toSubmit - submitted, waitCount, waitCount > 0 ? IORING_ENTER_GETEVENTS : 0);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+            }
+            submitted += static_cast<unsigned>(result);
+            waitCount = 0;
+        }
+    }
+
+    // Call fn for every completion that is available, without blocking
+    template<typename Fn>
+    void ForEachCompletion(Fn fn) {
+        unsigned head = *m_cqHead;
+        const unsigned tail = std::atomic_ref<unsigned>(*m_cqTail).load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const io_uring_cqe cqe = m_cqes[head & m_cqMask];
+            std::atomic_ref<unsigned>(*m_cqHead).store(head + 1, std::memory_order_release);
+            fn(cqe);
+        }
+    }
+
+    [[nodiscard]] unsigned GetEntries() const noexcept {
+        return m_sqEntries;
+    }
+
+private:
+    void Close() {
+        if (m_sqes && m_sqes != MAP_FAILED) {
+            ::munmap(m_sqes, m_sqesSize);
+        }
+        if (m_cqRing && m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+            ::munmap(m_cqRing, m_cqRingSize);
+        }
+        if (m_sqRing && m_sqRing != MAP_FAILED) {
+            ::munmap(m_sqRing, m_sqRingSize);
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+        m_sqes = nullptr;
+        m_cqRing = m_sqRing = nullptr;
+        m_fd = -1;
+    }
+
+    int m_fd = -1;
+    void* m_sqRing = nullptr;
+    void* m_cqRing = nullptr;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    size_t m_sqesSize = 0;
+
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned m_queued = 0;
+
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+};
+
+// A file being read. The driving thread owns the read side, hashing tasks own the hasher; the
+// fields between them are guarded by the reader mutex.
+struct UringFile {
+    size_t index = 0;
+    int fd = -1;
+    unsigned slot = 0;
+    uint64_t size = 0;
+    uint64_t submit_offset = 0;
+    unsigned in_flight = 0;
+    bool failed = false;
+    std::string error;
+    std::unique_ptr<Hasher> hasher;
+    // Pages that were cached before the file was opened, which Background mode leaves there
+    std::vector<unsigned char> resident;
+
+    // Guarded by the reader mutex: completed buffers by file offset, waiting for the ones before
+    // them to be hashed
+    std::map<uint64_t, std::pair<unsigned, size_t>> ready;
+    uint64_t hash_offset = 0;
+    bool hashing = false;
+};
+
+// One outstanding read, indexed by the buffer it reads into
+struct UringRead {
+    UringFile* file = nullptr;
+    uint64_t offset = 0;
+    size_t length = 0;
+    size_t done = 0;
+};
+
+class UringHashReader {
+public:
+    UringHashReader(const std::vector<fs::path>& paths, HashAlgorithm algorithm, unsigned queueDepth, ThreadPool& pool, const ReadOptions& readOptions)
+        : m_paths(paths), m_algorithm(algorithm), m_readOptions(readOptions), m_pool(pool), m_results(paths.size()),
+        m_ring(std::min(queueDepth, uring_max_entries)) {
+        m_bufferCount = std::min({ queueDepth, m_ring.GetEntries(), uring_max_buffers });
+        m_buffers.reset(static_cast<unsigned char*>(std::aligned_alloc(4096, m_bufferCount * uring_buffer_size)));
+        if (!m_buffers) {
+            throw std::bad_alloc();
+        }
+        m_reads.resize(m_bufferCount);
+
+        // Registered buffers and files spare the kernel a page pin and a file lookup per read.
+        // Both are optional: a low RLIMIT_MEMLOCK or an old kernel still gets plain reads.
+        std::vector<iovec> iovecs(m_bufferCount);
+        for (unsigned i = 0; i < m_bufferCount; ++i) {
+            iovecs[i] = { Buffer(i), uring_buffer_size };
+            m_freeBuffers.push_back(i);
+        }
+        m_fixedBuffers = m_ring.RegisterBuffers(iovecs.data(), m_bufferCount);
+
+        m_maxOpenFiles = m_bufferCount;
+        std::vector<int> slots(m_maxOpenFiles, -1);
+        m_fixedFiles = m_ring.RegisterFiles(slots.data(), m_maxOpenFiles);
+        for (unsigned i = 0; i < m_maxOpenFiles; ++i) {
+            m_freeSlots.push_back(i);
+        }
+    }
+
+    // Throws when the ring fails; the reads and hashing tasks it had started are finished first,
+    // so nothing refers to the reader once the exception leaves it
+    std::vector<FileHashResult> Run() {
+        unsigned inFlight = 0;
+        try {
+            Read(inFlight);
+        }
+        catch (...) {
+            Drain(inFlight);
+            throw;
+        }
+
+        // Special files the ring can't read by offset go through the stream
+        for (size_t index : m_fallback) {
+            try {
+                m_results[index].hash = compute_file_hash(m_paths[index], m_algorithm, 0, m_readOptions);
+                std::error_code ec;
+                m_results[index].bytes_read = fs::file_size(m_paths[index], ec);
+            }
+            catch (const std::exception& e) {
+                m_results[index].error = e.what();
+            }
+        }
+
+        return std::move(m_results);
+    }
+
+private:
+    struct FreeDeleter {
+        void operator()(unsigned char* data) const noexcept {
+            std::free(data);
+        }
+    };
+
+    void Read(unsigned& inFlight) {
+        size_t nextPath = 0;
+        while (nextPath < m_paths.size() || !m_open.empty()) {
+            // A cancelled scan opens no more files and queues no more reads; the ones in flight
+            // complete and their files close as failed
+            if (m_readOptions.cancel && m_readOptions.cancel->IsCancelled()) {
+                for (; nextPath < m_paths.size(); ++nextPath) {
+                    m_results[nextPath].error = ScanCancelled().what();
+                }
+                for (auto& file : m_open) {
+                    if (!file->failed && file->submit_offset < file->size) {
+                        file->failed = true;
+                        file->error = ScanCancelled().what();
+                    }
+                }
+            }
+
+            // Keep as many files open as there are reads to spread over them
+            while (nextPath < m_paths.size() && !m_freeSlots.empty()) {
+                if (!Open(nextPath)) {
+                    m_fallback.push_back(nextPath);
+                }
+                ++nextPath;
+            }
+            const bool closed = CloseFinished();
+
+            // Hand free buffers to the open files in turn, so small files don't wait behind a large one
+            unsigned queued = 0;
+            for (bool progress = true; progress;) {
+                progress = false;
+                for (auto& file : m_open) {
+                    if (file->failed || file->submit_offset >= file->size) {
+                        continue;
+                    }
+                    std::optional<unsigned> buffer = TakeFreeBuffer();
+                    if (!buffer) {
+                        break;
+                    }
+                    const size_t length = static_cast<size_t>(std::min<uint64_t>(uring_buffer_size, file->size - file->submit_offset));
+                    m_reads[*buffer] = { file.get(), file->submit_offset, length, 0 };
+                    file->submit_offset += length;
+                    ++file->in_flight;
+                    QueueRead(*buffer);
+                    ++queued;
+                    progress = true;
+                }
+            }
+            inFlight += queued;
+
+            if (inFlight > 0) {
+                m_ring.Submit(1);
+                m_ring.ForEachCompletion([&](const io_uring_cqe& cqe) {
+                    if (Complete(static_cast<unsigned>(cqe.user_data), cqe.res)) {
+                        --inFlight;
+                    }
+                    });
+            }
+            else if (!closed && !m_open.empty()) {
+                // Nothing to read until the hashers return buffers or finish files
+                std::unique_lock lock(m_mutex);
+                m_changed.wait(lock, [&] { return !m_hashed.empty(); });
+            }
+        }
+
+    }
+
+    // Wait for the reads still in the kernel, as far as the ring lets us, and for the hashing
+    // tasks still queued on the pool
+    void Drain(unsigned inFlight) {
+        try {
+            while (inFlight > 0) {
+                m_ring.Submit(1);
+                m_ring.ForEachCompletion([&](const io_uring_cqe&) { --inFlight; });
+            }
+        }
+        catch (const std::exception&) {
+            // Closing the ring cancels what is left; it is closed before the buffers are freed
+        }
+        std::unique_lock lock(m_mutex);
+        m_changed.wait(lock, [&] { return m_hashTasks == 0; });
+        for (const auto& file : m_open) {
+            ::close(file->fd);
+        }
+        m_open.clear();
+    }
+
+    unsigned char* Buffer(unsigned index) {
+        return m_buffers.get() + static_cast<size_t>(index) * uring_buffer_size;
+    }
+
+    std::optional<unsigned> TakeFreeBuffer() {
+        std::lock_guard lock(m_mutex);
+        if (m_freeBuffers.empty()) {
+            return std::nullopt;
+        }
+        unsigned buffer = m_freeBuffers.back();
+        m_freeBuffers.pop_back();
+        return buffer;
+    }
+
+    // Open the file and give it a fixed file slot. Returns false for files that are not regular
+    // files; they are hashed through the stream once the ring is done.
+    bool Open(size_t index) {
+        const int fd = open_for_reading(m_paths[index], m_readOptions.mode);
+        if (fd < 0) {
+            m_results[index].error = "Failed to open file: " + m_paths[index].string();
+            return true;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            return false;
+        }
+
+        auto file = std::make_unique<UringFile>();
+        file->index = index;
+        file->fd = fd;
+        file->size = static_cast<uint64_t>(st.st_size);
+        file->hasher = create_hasher(m_algorithm);
+        file->resident = get_resident_pages(fd, m_readOptions.mode);
+        file->slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        if (m_fixedFiles && !m_ring.UpdateFile(file->slot, fd)) {
+            m_fixedFiles = false;
+        }
+        m_open.push_back(std::move(file));
+        return true;
+    }
+
+    void QueueRead(unsigned buffer) {
+        const UringRead& read = m_reads[buffer];
+        throttle_read(m_readOptions, read.length - read.done);
+        io_uring_sqe* sqe = m_ring.NextSqe();
+        sqe->opcode = m_fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        if (m_fixedFiles) {
+            sqe->fd = static_cast<int>(read.file->slot);
+            sqe->flags = IOSQE_FIXED_FILE;
+        }
+        else {
+            sqe->fd = read.file->fd;
+        }
+        sqe->off = read.offset + read.done;
+        sqe->addr = reinterpret_cast<uint64_t>(Buffer(buffer) + read.done);
+        sqe->len = static_cast<uint32_t>(read.length - read.done);
+        if (m_fixedBuffers) {
+            sqe->buf_index = static_cast<uint16_t>(buffer);
+        }
+        sqe->user_data = buffer;
+    }
+
+    // Handle the completion of the read into buffer. Returns false when the read was requeued
+    // for the rest of a short read.
+    bool Complete(unsigned buffer, int result) {
+        UringRead& read = m_reads[buffer];
+        UringFile& file = *read.file;
+        if (result > 0) {
+            count_read(m_readOptions, static_cast<uint64_t>(result));
+        }
+        // The throttle was charged for the whole rest of the read; a requeued rest is charged again
+        const size_t transferred = result > 0 ? static_cast<size_t>(result) : 0;
+        refund_read(m_readOptions, read.length - read.done - std::min(transferred, read.length - read.done));
+
+        if (result > 0 && read.done + static_cast<size_t>(result) < read.length) {
+            read.done += static_cast<size_t>(result);
+            QueueRead(buffer);
+            return false;
+        }
+
+        --file.in_flight;
+        if (result <= 0) {
+            file.failed = true;
+            if (file.error.empty()) {
+                file.error = result < 0
+                    ? "Failed to read file: " + m_paths[file.index].string() + ": " + std::strerror(-result)
+                    : "File changed while reading: " + m_paths[file.index].string();
+            }
+            std::lock_guard lock(m_mutex);
+            m_freeBuffers.push_back(buffer);
+            return true;
+        }
+
+        bool startHashing = false;
+        {
+            std::lock_guard lock(m_mutex);
+            file.ready.emplace(read.offset, std::make_pair(buffer, read.length));
+            if (!file.hashing && read.offset == file.hash_offset) {
+                file.hashing = true;
+                startHashing = true;
+            }
+        }
+        if (startHashing) {
+            {
+                std::lock_guard lock(m_mutex);
+                ++m_hashTasks;
+            }
+            UringFile* target = &file;
+            m_pool.Submit([this, target] { Hash(*target); });
+        }
+        return true;
+    }
+
+    // Hash the buffers of the file that are ready in order, on a pool worker
+    void Hash(UringFile& file) {
+        std::unique_lock lock(m_mutex);
+        for (;;) {
+            auto it = file.ready.find(file.hash_offset);
+            if (it == file.ready.end()) {
+                break;
+            }
+            const auto [buffer, length] = it->second;
+            file.ready.erase(it);
+
+            lock.unlock();
+            file.hasher->Update(Buffer(buffer), length);
+            lock.lock();
+
+            file.hash_offset += length;
+            m_freeBuffers.push_back(buffer);
+        }
+        file.hashing = false;
+        m_hashed.push_back(&file);
+        --m_hashTasks;
+        m_changed.notify_all();
+    }
+
+    // Close the files that are completely read and hashed, or failed with nothing in flight.
+    // Returns whether any file was closed.
+    bool CloseFinished() {
+        std::lock_guard lock(m_mutex);
+        m_hashed.clear();
+
+        bool closed = false;
+        for (auto it = m_open.begin(); it != m_open.end();) {
+            UringFile& file = **it;
+            const bool done = file.failed ? file.in_flight == 0 : file.hash_offset == file.size;
+            if (!done || file.hashing) {
+                ++it;
+                continue;
+            }
+
+            for (const auto& [offset, ready] : file.ready) {
+                m_freeBuffers.push_back(ready.first);
+            }
+
+            FileHashResult& result = m_results[file.index];
+            if (file.failed) {
+                result.error = file.error;
+            }
+            else {
+                result.hash = file.hasher->Final();
+                result.bytes_read = file.size;
+            }
+
+            if (m_fixedFiles) {
+                m_ring.UpdateFile(file.slot, -1);
+            }
+            release_cached_pages(file.fd, m_readOptions.mode, file.resident);
+            ::close(file.fd);
+            m_freeSlots.push_back(file.slot);
+            it = m_open.erase(it);
+            closed = true;
+        }
+        return closed;
+    }
+
+    const std::vector<fs::path>& m_paths;
+    HashAlgorithm m_algorithm;
+    ReadOptions m_readOptions;
+    ThreadPool& m_pool;
+    std::vector<FileHashResult> m_results;
+    std::vector<size_t> m_fallback;
+
+    unsigned m_bufferCount = 0;
+    std::unique_ptr<unsigned char, FreeDeleter> m_buffers;
+    std::vector<UringRead> m_reads;
+    // Declared after the buffers, so that the ring is closed before they are freed
+    IoUring m_ring;
+    bool m_fixedBuffers = false;
+    bool m_fixedFiles = false;
+
+    unsigned m_maxOpenFiles = 0;
+    std::vector<unsigned> m_freeSlots;
+    std::deque<std::unique_ptr<UringFile>> m_open;
+
+    // Shared with the hashing tasks
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<unsigned> m_freeBuffers;
+    std::vector<UringFile*> m_hashed;
+    // Hashing tasks submitted to the pool that haven't returned yet
+    unsigned m_hashTasks = 0;
+};
+
+} // namespace
+
+bool is_uring_available() {
+    static const bool available = [] {
+        try {
+            IoUring ring(2);
+            return true;
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }();
+    return available;
+}
+
+std::vector<FileHashResult> compute_file_hashes_uring(const std::vector<fs::path>& file_paths, HashAlgorithm algorithm,
+    unsigned queue_depth, ThreadPool& pool, const ReadOptions& read_options) {
+    if (!is_uring_available()) {
+        throw std::runtime_error("io_uring is not available");
+    }
+    if (file_paths.empty()) {
+        return {};
+    }
+
+    UringHashReader reader(file_paths, algorithm, std::max(1u, queue_depth), pool, read_options);
+    auto results = reader.Run();
+    // Hashing tasks may still be returning from their last buffer
+    pool.Wait();
+    return results;
+}
+
+#else
+
+bool is_uring_available() {
+    return false;
+}
+
+std::vector<FileHashResult> compute_file_hashes_uring(const std::vector<fs::path>&, HashAlgorithm, unsigned, ThreadPool&, const ReadOptions&) {
+    throw std::runtime_error("io_uring is not available");
+}
+
+#endif
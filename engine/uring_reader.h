@@ -0,0 +1,22 @@
+#pragma once
+
+#include "hashing.h"
+
+#include <vector>
+
+class ThreadPool;
+
+// Whether the kernel lets this process create an io_uring instance. Checked once; always false
+// off Linux.
+bool is_uring_available();
+
+// Compute full hashes of files with reads issued through io_uring. Up to queue_depth reads into
+// registered buffers are in flight at any time, spread over as many files as it takes, and every
+// completed buffer is handed to the pool to be hashed in file order. The depth is clamped to what
+// the kernel accepts. Throws when io_uring is not available or the ring can't be set up or
+// driven, for instance for lack of memory or locked memory, after the reads and hashing tasks it
+// had started have finished; callers then hash the files with compute_file_hash on the pool. In
+// Background mode files are opened and released as FileReader does, and every read waits for the
+// throttle.
+std::vector<FileHashResult> compute_file_hashes_uring(const std::vector<fs::path>& file_paths, HashAlgorithm algorithm,
+    unsigned queue_depth, ThreadPool& pool, const ReadOptions& read_options = {});